@@ -4,6 +4,30 @@
 #include <libformal/automaton.hpp>
 
 namespace formal {
+    enum class MinimizationAlgorithm {
+        /// Iterative refinement by transition signatures, O(n^2 |sigma| log n)
+        Moore,
+        /// Partition refinement by Valmari & Lehtinen, O(m log n)
+        Hopcroft
+    };
+
+    enum class ProductOperation {
+        Intersection,
+        Union,
+        /// Words of the left operand which the right one rejects
+        Difference,
+        SymmetricDifference
+    };
+
+    enum class EliminationOrder {
+        /// First eliminable state in states order
+        Legacy,
+        /// State with min (in-degree * out-degree), that's the count of shortcuts it adds
+        MinDegree,
+        /// State whose elimination grows total expression size the least
+        MinWeight
+    };
+
     /**
      * Creates a cute graphical representation for given automation using Graphvis
      * @param automaton Automaton to dump
@@ -27,26 +51,38 @@ namespace formal {
      * Transforms NFA to IsDFA
      * @param automaton Automaton to process. Must have defined initial state.
      * All transitions must be single-letter
+     * @param threads_count Worker threads count. Above 1 subsets are expanded in parallel with work stealing,
+     * the result is the same
      */
-    void TransformToDFA(Automaton& automaton);
+    void TransformToDFA(Automaton& automaton, int threads_count = 1);
 
     /**
      * Transforms IsDFA to CDFA
      * @param automaton Automaton to process. Must be IsDFA.
+     * @param virtual_sink Don't add a drain state, just let missing transitions lead to the implicit sink.
+     * Otherwise the implicit sink (if any) is materialized
      */
-    void CompleteDFA(Automaton& automaton);
+    void CompleteDFA(Automaton& automaton, bool virtual_sink = false);
 
     /**
-     * Complements given CDFA (L(A) -> \sigma^* - L(A))
+     * Complements given CDFA (L(A) -> \sigma^* - L(A)). The implicit sink is complemented as well
      * @param automaton Automaton to process. Must be CDFA.
      */
     void ComplementCDFA(Automaton& automaton);
 
     /**
-     * Minimizes CDFA
+     * Minimizes CDFA. States equivalent to the virtual sink (if any) are dropped
      * @param automaton Automaton to process
+     * @param algorithm Refinement algorithm to use
+     */
+    void MinimizeCDFA(Automaton& automaton, MinimizationAlgorithm algorithm = MinimizationAlgorithm::Hopcroft);
+
+    /**
+     * Minimizes partial DFA without materializing a drain state (Valmari's partial DFA minimization).
+     * Result is the minimal CDFA without its sink
+     * @param automaton Automaton to process. Must be IsDFA.
      */
-    void MinimizeCDFA(Automaton& automaton);
+    void MinimizeDFA(Automaton& automaton);
 
     /**
      * Makes |F|=1 (breaking all properties :) )
@@ -58,8 +94,9 @@ namespace formal {
      * Generates a regular expression for the given automaton.
      * Note that automaton is completely trashed by this method
      * @param automaton Automaton to process.
+     * @param order Order of states elimination
      */
-     std::string NFAToRegExp(Automaton& automaton);
+     std::string NFAToRegExp(Automaton& automaton, EliminationOrder order = EliminationOrder::Legacy);
 
     /**
      * Tries to read given word in given DFA
@@ -68,6 +105,53 @@ namespace formal {
      */
     bool DFAReadWord(const Automaton& automaton, const std::string& word);
 
+    /**
+     * Tries to read given word in given NFA without determinization, see NFAMatcher
+     * @param automaton Automaton without eps-transitions with single-letter transitions only
+     * @return True if word is accepted by automaton, false otherwise
+     */
+    bool NFAReadWord(const Automaton& automaton, const std::string& word);
+
+    /**
+     * Builds product of two DFAs, only pairs reachable from the initial pair become states.
+     * A missing transition of an operand leads to its implicit sink, the pair of both sinks is the product sink
+     * @param lhs Left operand. Must be IsDFA with defined initial state
+     * @param rhs Right operand. Must be IsDFA with defined initial state
+     * @param operation Which pairs are final
+     * @return DFA over both alphabets
+     */
+    Automaton BuildProduct(const Automaton& lhs, const Automaton& rhs, ProductOperation operation);
+
+    Automaton Intersect(const Automaton& lhs, const Automaton& rhs);
+    Automaton Union(const Automaton& lhs, const Automaton& rhs);
+    Automaton Difference(const Automaton& lhs, const Automaton& rhs);
+    Automaton SymmetricDifference(const Automaton& lhs, const Automaton& rhs);
+
+    /**
+     * Checks product language to be empty without building the product, stops at the first final pair
+     * @return True if no word is accepted by the product
+     */
+    bool IsProductEmpty(const Automaton& lhs, const Automaton& rhs, ProductOperation operation);
+
+    /**
+     * Checks two DFAs to accept the same language by Hopcroft-Karp union-find, no minimization needed
+     * @param lhs Must be IsDFA with defined initial state
+     * @param rhs Must be IsDFA with defined initial state
+     * @param counterexample If not null, gets a shortest word accepted by exactly one of automata
+     * @return True if languages are equal, false otherwise
+     */
+    bool AreEquivalent(const Automaton& lhs, const Automaton& rhs, std::string* counterexample = nullptr);
+
+    /**
+     * Checks language of lhs to be a subset of language of rhs. Subsets of rhs states are explored
+     * along lhs states, a pair is skipped if it is covered by some explored pair with a smaller subset (antichains)
+     * @param lhs Automaton without eps-transitions with single-letter transitions only
+     * @param rhs Automaton without eps-transitions with single-letter transitions only
+     * @param counterexample If not null, gets a shortest word accepted by lhs and rejected by rhs
+     * @return True if L(lhs) is included in L(rhs), false otherwise
+     */
+    bool IsIncluded(const Automaton& lhs, const Automaton& rhs, std::string* counterexample = nullptr);
+
     /**
      * Checks given DFA to be CDFA
      * @param automaton Automaton
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+
+namespace formal {
+    class Automaton;
+
+    /**
+     * Set of bytes as a 256-bit bitset. Iterates over letters in increasing byte order
+     */
+    class LetterSet {
+    public:
+        using Word = uint64_t;
+        static constexpr int WORDS_COUNT = 4;
+
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = char;
+            using reference = char;
+
+            Iterator() : owner_(nullptr), pos_(256) {}
+            Iterator(const LetterSet* owner, int pos) : owner_(owner), pos_(owner->FindNext(pos)) {}
+
+            char operator*() const {
+                return static_cast<char>(pos_);
+            }
+
+            Iterator& operator++() {
+                pos_ = owner_->FindNext(pos_ + 1);
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return pos_ == other.pos_;
+            }
+
+        private:
+            const LetterSet* owner_;
+            int pos_;
+        };
+
+        LetterSet() : words_{} {}
+
+        LetterSet(std::initializer_list<char> letters) : words_{} {
+            for (char letter : letters) {
+                Insert(letter);
+            }
+        }
+
+        bool Contains(char letter) const {
+            auto byte = static_cast<unsigned char>(letter);
+            return (words_[byte / 64] >> (byte % 64)) & 1;
+        }
+
+        void Insert(char letter) {
+            auto byte = static_cast<unsigned char>(letter);
+            words_[byte / 64] |= Word(1) << (byte % 64);
+        }
+
+        void Erase(char letter) {
+            auto byte = static_cast<unsigned char>(letter);
+            words_[byte / 64] &= ~(Word(1) << (byte % 64));
+        }
+
+        size_t Size() const {
+            size_t size = 0;
+            for (Word word : words_) {
+                size += std::popcount(word);
+            }
+
+            return size;
+        }
+
+        bool Empty() const {
+            return words_ == std::array<Word, WORDS_COUNT>{};
+        }
+
+        LetterSet& operator|=(const LetterSet& other) {
+            for (int i = 0; i < WORDS_COUNT; i++) {
+                words_[i] |= other.words_[i];
+            }
+
+            return *this;
+        }
+
+        bool operator==(const LetterSet& other) const = default;
+
+        Iterator begin() const {
+            return { this, 0 };
+        }
+
+        Iterator end() const {
+            return {};
+        }
+
+    private:
+        /// First letter not less than pos, 256 if there is none
+        int FindNext(int pos) const {
+            while (pos < 256) {
+                Word word = words_[pos / 64] >> (pos % 64);
+                if (word != 0) {
+                    return pos + std::countr_zero(word);
+                }
+
+                pos = (pos / 64 + 1) * 64;
+            }
+
+            return 256;
+        }
+
+    private:
+        std::array<Word, WORDS_COUNT> words_;
+    };
+
+    /**
+     * Partition of all bytes into classes which no transition of an automaton tells apart.
+     * Letters of the alphabet never share a class with other bytes. Classes are numbered by their smallest byte,
+     * so bytes outside the alphabet and without transitions usually end up in class 0
+     */
+    class ByteClasses {
+    public:
+        /// Every byte in its own class
+        ByteClasses();
+
+        /**
+         * Bytes are in the same class if every state has the same destinations by them.
+         * Letters inside multi-letter transition words get classes of their own
+         */
+        explicit ByteClasses(const Automaton& automaton);
+
+        int GetClass(char letter) const {
+            return classes_[static_cast<unsigned char>(letter)];
+        }
+
+        int GetClassesCount() const {
+            return classes_count_;
+        }
+
+        /// Smallest byte of the class
+        char GetRepresentative(int cls) const {
+            return static_cast<char>(representatives_[cls]);
+        }
+
+        bool IsRepresentative(char letter) const {
+            return GetRepresentative(GetClass(letter)) == letter;
+        }
+
+        LetterSet GetLetters(int cls) const;
+
+        /// Byte to class map, suitable for table lookups
+        const std::array<uint8_t, 256>& GetMap() const {
+            return classes_;
+        }
+
+    private:
+        std::array<uint8_t, 256> classes_;
+        std::array<uint8_t, 256> representatives_;
+        int classes_count_;
+    };
+}
@@ -1,23 +1,72 @@
 #pragma once
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
 #include <map>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 #include <set>
 #include <memory>
+#include <utility>
+#include <vector>
+#include <libformal/alphabet.hpp>
 
 namespace formal {
     class AutomatonState;
 
+    /// Dense index of the state inside its automaton
+    using StateId = uint32_t;
+
+    /// Transition label id. Single letters are their byte values, longer words are interned per automaton
+    using SymbolId = uint32_t;
+
+    inline constexpr SymbolId EPS_SYMBOL = 256;
+    inline constexpr SymbolId NO_SYMBOL = UINT32_MAX;
+
+    inline SymbolId LetterToSymbol(char letter) {
+        return static_cast<unsigned char>(letter);
+    }
+
     /**
-     * Nondeterministic finite automaton
+     * Compact transition: label and the other end (destination for forward transitions,
+     * source for back ones)
+     */
+    struct Transition {
+        SymbolId symbol;
+        StateId target;
+
+        auto operator<=>(const Transition& other) const = default;
+    };
+
+    /// Sorted by (symbol, target)
+    using TransitionList = std::vector<Transition>;
+
+    class TransitionRange;
+
+    /// Where missing transitions of a DFA lead to
+    enum class ImplicitSink {
+        /// Nowhere, the automaton is just partial
+        None,
+        /// Virtual non-final drain, the automaton is considered complete
+        Rejecting,
+        /// Virtual final drain, the automaton is considered complete
+        Accepting
+    };
+
+    /**
+     * Nondeterministic finite automaton.
+     * States are allocated in slabs owned by the automaton and addressed by dense StateIds
      */
     class Automaton {
         friend class AutomatonState;
 
     public:
-        explicit Automaton(std::unordered_set<char> alphabet = { 'a', 'b' });
+        explicit Automaton(LetterSet alphabet = { 'a', 'b' });
         ~Automaton();
 
         // I'm lazy ¯\_(ツ)_/¯
@@ -29,14 +78,27 @@ namespace formal {
 
         AutomatonState* InsertState();
 
-        const auto& GetAlphabet() const {
+        const LetterSet& GetAlphabet() const {
             return alphabet_;
         }
 
+        /// Live states in a contiguous vector
         const auto& GetStates() const {
             return states_;
         }
 
+        /**
+         * @return State with given id or nullptr if it was removed
+         */
+        AutomatonState* GetState(StateId id) const {
+            return states_by_id_[id];
+        }
+
+        /// Upper bound for ids of all states ever inserted (suitable for id-indexed tables)
+        StateId GetStateIdBound() const {
+            return static_cast<StateId>(states_by_id_.size());
+        }
+
         AutomatonState* GetInitialState() const {
             return initial_state_;
         }
@@ -45,14 +107,43 @@ namespace formal {
             initial_state_ = nullptr;
         }
 
+        ImplicitSink GetImplicitSink() const {
+            return implicit_sink_;
+        }
+
+        void SetImplicitSink(ImplicitSink implicit_sink) {
+            implicit_sink_ = implicit_sink;
+        }
+
         const auto& GetFinalStates() const {
             return final_states_;
         }
 
-        bool Belongs(AutomatonState* state) const {
-            return states_.find(state) != states_.end();
+        bool Belongs(AutomatonState* state) const;
+
+        /**
+         * @return Symbol for given transition label, interning it if necessary
+         */
+        SymbolId InternWord(const std::string& word);
+
+        /**
+         * @return Symbol for given transition label or NO_SYMBOL if it was never interned
+         */
+        SymbolId FindWord(const std::string& word) const;
+
+        const std::string& GetWord(SymbolId symbol) const {
+            if (symbol <= EPS_SYMBOL) {
+                return LetterWords()[symbol];
+            }
+
+            return words_[symbol - EPS_SYMBOL - 1];
         }
 
+        /**
+         * Drops the back transitions index. It is rebuilt on the next demand
+         */
+        void ReleaseBackTransitions();
+
         bool RespectsAlphabet() const {
             if (!respect_alphabet_) {
                 ActualizeProperties();
@@ -86,25 +177,136 @@ namespace formal {
         }
 
     private:
-        int GetNextNodeId() {
-            return node_counter_++;
+        StateId GetNextNodeId() const {
+            return GetStateIdBound();
         }
 
-        void OnNewTransition(AutomatonState* src, AutomatonState* dst, const std::string& word);
+        /// Destroys the state in place, its slab slot is never reused
+        void ReleaseState(AutomatonState* state);
+        void ReleaseArena();
+
+        void OnNewTransition(AutomatonState* src, AutomatonState* dst, SymbolId symbol);
+        void OnRemovedTransition(AutomatonState* src, AutomatonState* dst, SymbolId symbol);
         void ActualizeProperties() const;
 
+        /// Back transitions are not maintained until someone asks for them
+        const TransitionList& GetBackTransitionsOf(StateId id) const {
+            if (!back_transitions_built_) {
+                BuildBackTransitions();
+            }
+
+            return back_transitions_[id];
+        }
+
+        void BuildBackTransitions() const;
+
+        /// Words for single letters and eps, indexed by symbol
+        static const std::string* LetterWords();
+
     private:
         // TODO: better architectural approach for this properties?
-        std::unordered_set<char> alphabet_;
+        LetterSet alphabet_;
         mutable bool respect_alphabet_;
         mutable bool no_eps_;
         mutable bool single_letter_;
         mutable bool dfa_;
 
-        std::unordered_set<AutomatonState*> states_;
+        static constexpr size_t SLAB_SIZE = 256;
+
+        /// Raw storage for SLAB_SIZE states each. States never move and the whole arena is freed at once
+        std::vector<std::unique_ptr<std::byte[]>> slabs_;
+        /// Indexed by StateId, nullptr for removed states
+        std::vector<AutomatonState*> states_by_id_;
+        std::vector<AutomatonState*> states_;
+
         std::unordered_set<AutomatonState*> final_states_;
         AutomatonState* initial_state_;
+        ImplicitSink implicit_sink_;
+
+        /// Multi-letter words, symbol EPS_SYMBOL + 1 + i is words_[i]. Deque keeps references stable
+        std::deque<std::string> words_;
+        std::unordered_map<std::string_view, SymbolId> word_symbols_;
+
+        /// Indexed by StateId, valid only if back_transitions_built_
+        mutable std::vector<TransitionList> back_transitions_;
+        mutable bool back_transitions_built_;
+    };
+
+    /**
+     * View over compact transitions which resolves them into (word, state) pairs
+     */
+    class TransitionRange {
+    public:
+        using value_type = std::pair<const std::string&, AutomatonState*>;
+
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = TransitionRange::value_type;
+            using reference = value_type;
+
+            /// operator-> has to return something dereferencable
+            struct ArrowProxy {
+                value_type value;
+
+                const value_type* operator->() const {
+                    return &value;
+                }
+            };
+
+            Iterator() : owner_(nullptr) {}
+            Iterator(const Automaton* owner, TransitionList::const_iterator iter) : owner_(owner), iter_(iter) {}
+
+            value_type operator*() const {
+                return { owner_->GetWord(iter_->symbol), owner_->GetState(iter_->target) };
+            }
+
+            ArrowProxy operator->() const {
+                return { **this };
+            }
 
-        int node_counter_;
+            Iterator& operator++() {
+                ++iter_;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator old = *this;
+                ++iter_;
+                return old;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return iter_ == other.iter_;
+            }
+
+        private:
+            const Automaton* owner_;
+            TransitionList::const_iterator iter_;
+        };
+
+        TransitionRange(const Automaton* owner, const TransitionList& transitions) :
+            owner_(owner), transitions_(transitions) {}
+
+        Iterator begin() const {
+            return { owner_, transitions_.begin() };
+        }
+
+        Iterator end() const {
+            return { owner_, transitions_.end() };
+        }
+
+        size_t size() const {
+            return transitions_.size();
+        }
+
+        bool empty() const {
+            return transitions_.empty();
+        }
+
+    private:
+        const Automaton* owner_;
+        const TransitionList& transitions_;
     };
 }
\ No newline at end of file
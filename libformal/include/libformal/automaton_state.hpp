@@ -1,7 +1,7 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
-#include <map>
 #include <libformal/automaton.hpp>
 
 namespace formal {
@@ -10,54 +10,95 @@ namespace formal {
      */
     class AutomatonState {
         friend class Automaton;
-        using TransitionSet = std::multimap<std::string, AutomatonState*>;
 
     public:
         AutomatonState() = delete;
         explicit AutomatonState(Automaton* owner) :
-          owner_(owner), final_(false), node_id_(owner->GetNextNodeId()), label_(std::to_string(node_id_)) {}
+          owner_(owner), final_(false), node_id_(owner->GetNextNodeId()), label_(std::to_string(node_id_)),
+          position_(0) {}
 
         bool TransitionPresent(const std::string& word, AutomatonState* dst_state) const {
-            return GetTransitionIter(word, dst_state) != transitions_.end();
+            SymbolId symbol = owner_->FindWord(word);
+            return symbol != NO_SYMBOL && TransitionPresent(symbol, dst_state);
+        }
+
+        bool TransitionPresent(SymbolId symbol, AutomatonState* dst_state) const {
+            return std::binary_search(transitions_.begin(), transitions_.end(),
+                                      Transition{ symbol, dst_state->GetNodeId() });
         }
 
         void AddTransition(const std::string& word, AutomatonState* dst_state) {
+            AddTransition(owner_->InternWord(word), dst_state);
+        }
+
+        void AddTransition(SymbolId symbol, AutomatonState* dst_state) {
             assert(owner_->Belongs(dst_state));
-            if (TransitionPresent(word, dst_state)) {
+
+            Transition transition{ symbol, dst_state->GetNodeId() };
+            auto iter = std::lower_bound(transitions_.begin(), transitions_.end(), transition);
+            if (iter != transitions_.end() && *iter == transition) {
                 return;
             }
 
-            transitions_.insert({word, dst_state});
-            dst_state->back_transitions_.insert({word, this});
-
-            owner_->OnNewTransition(this, dst_state, word);
+            transitions_.insert(iter, transition);
+            owner_->OnNewTransition(this, dst_state, symbol);
         }
 
         void RemoveTransition(const std::string& word, AutomatonState* dst_state) {
+            SymbolId symbol = owner_->FindWord(word);
+            assert(symbol != NO_SYMBOL);
+            if (symbol == NO_SYMBOL) {
+                return;
+            }
+
+            RemoveTransition(symbol, dst_state);
+        }
+
+        void RemoveTransition(SymbolId symbol, AutomatonState* dst_state) {
             assert(owner_->Belongs(dst_state));
 
-            auto transition_iter = GetTransitionIter(word, dst_state);
-            assert(transition_iter != transitions_.end());
-            if (transition_iter == transitions_.end()) {
+            Transition transition{ symbol, dst_state->GetNodeId() };
+            auto iter = std::lower_bound(transitions_.begin(), transitions_.end(), transition);
+            assert(iter != transitions_.end() && *iter == transition);
+            if (iter == transitions_.end() || *iter != transition) {
                 return;
             }
 
-            transitions_.erase(transition_iter);
+            transitions_.erase(iter);
+            owner_->OnRemovedTransition(this, dst_state, symbol);
+        }
 
-            auto back_transition_iter = dst_state->GetBackTransitionIter(word, this);
-            assert(back_transition_iter != dst_state->back_transitions_.end());
-            dst_state->back_transitions_.erase(back_transition_iter);
+        /// Transitions resolved into (word, state) pairs
+        TransitionRange GetTransitions() const {
+            return { owner_, transitions_ };
         }
 
-        const auto& GetTransitions() const {
+        /// Raw transitions sorted by (symbol, target)
+        const TransitionList& GetEdges() const {
             return transitions_;
         }
 
-        const auto& GetBackTransitions() const {
-            return back_transitions_;
+        /**
+         * Back transitions are (word, source state) pairs.
+         * The index is built by the owner on the first demand
+         */
+        TransitionRange GetBackTransitions() const {
+            return { owner_, owner_->GetBackTransitionsOf(node_id_) };
         }
 
-        int GetNodeId() const {
+        /**
+         * @return Some destination of the transition by given symbol or nullptr if there is none
+         */
+        AutomatonState* FindTransition(SymbolId symbol) const {
+            auto iter = std::lower_bound(transitions_.begin(), transitions_.end(), Transition{ symbol, 0 });
+            if (iter == transitions_.end() || iter->symbol != symbol) {
+                return nullptr;
+            }
+
+            return owner_->GetState(iter->target);
+        }
+
+        StateId GetNodeId() const {
             return node_id_;
         }
 
@@ -97,15 +138,15 @@ namespace formal {
 
         void Remove() {
             // Yes, we need a copy
-            auto transitions = GetTransitions();
-            for (auto& [word, dst_state] : transitions) {
-                RemoveTransition(word, dst_state);
+            TransitionList transitions = transitions_;
+            for (Transition transition : transitions) {
+                RemoveTransition(transition.symbol, owner_->GetState(transition.target));
             }
 
             // Yes, we need a copy
-            auto back_transitions = GetBackTransitions();
-            for (auto& [word, back_state] : back_transitions) {
-                back_state->RemoveTransition(word, this);
+            TransitionList back_transitions = owner_->GetBackTransitionsOf(node_id_);
+            for (Transition back_transition : back_transitions) {
+                owner_->GetState(back_transition.target)->RemoveTransition(back_transition.symbol, this);
             }
 
             UnmarkAsFinal();
@@ -113,45 +154,26 @@ namespace formal {
                 owner_->ClearInitialState();
             }
 
-            owner_->states_.erase(this);
-            delete this;
+            owner_->ReleaseState(this);
         }
 
     private:
-        TransitionSet::const_iterator GetTransitionIter(const std::string& word, AutomatonState* state) const {
-            return GetTransitionIntl(transitions_, word, state);
-        }
-
-        TransitionSet::const_iterator GetBackTransitionIter(const std::string& word, AutomatonState* state) const {
-            return GetTransitionIntl(back_transitions_, word, state);
-        }
-
-        static TransitionSet::const_iterator GetTransitionIntl(const TransitionSet& transitions,
-                                  const std::string& word, AutomatonState* state) {
-            auto range = transitions.equal_range(word);
-            for (auto iter = range.first; iter != range.second; iter++) {
-                if (iter->first == word && iter->second == state) {
-                    return iter;
-                }
-            }
-
-            return transitions.end();
-        }
-
         // Used by Automaton move constructor
         void ReassignOwner(Automaton* owner) {
             owner_ = owner;
         }
 
     private:
-        TransitionSet transitions_;
-        TransitionSet back_transitions_;
+        TransitionList transitions_;
 
-        int node_id_;
+        StateId node_id_;
         std::string label_;
 
+        /// Index in the owner's live states vector
+        size_t position_;
+
         bool final_;
 
         Automaton* owner_;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace formal {
+    /**
+     * Fixed-size (after construction) bitset working a whole 64-bit word at a time
+     */
+    class DynamicBitset {
+    public:
+        using Word = uint64_t;
+        static constexpr int WORD_BITS = 64;
+
+        DynamicBitset() : size_(0) {}
+        explicit DynamicBitset(size_t size) : words_(WordsCount(size), 0), size_(size) {}
+
+        static size_t WordsCount(size_t size) {
+            return (size + WORD_BITS - 1) / WORD_BITS;
+        }
+
+        size_t Size() const {
+            return size_;
+        }
+
+        bool Test(size_t pos) const {
+            return (words_[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1;
+        }
+
+        void Set(size_t pos) {
+            words_[pos / WORD_BITS] |= Word(1) << (pos % WORD_BITS);
+        }
+
+        void Reset(size_t pos) {
+            words_[pos / WORD_BITS] &= ~(Word(1) << (pos % WORD_BITS));
+        }
+
+        void Clear() {
+            std::fill(words_.begin(), words_.end(), 0);
+        }
+
+        bool Any() const {
+            for (Word word : words_) {
+                if (word != 0) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        size_t Count() const {
+            size_t count = 0;
+            for (Word word : words_) {
+                count += std::popcount(word);
+            }
+
+            return count;
+        }
+
+        bool Intersects(const DynamicBitset& other) const {
+            for (size_t i = 0; i < words_.size(); i++) {
+                if ((words_[i] & other.words_[i]) != 0) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /// True if every bit of this is set in other
+        bool IsSubsetOf(const DynamicBitset& other) const {
+            for (size_t i = 0; i < words_.size(); i++) {
+                if ((words_[i] & ~other.words_[i]) != 0) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        DynamicBitset& operator|=(const DynamicBitset& other) {
+            for (size_t i = 0; i < words_.size(); i++) {
+                words_[i] |= other.words_[i];
+            }
+
+            return *this;
+        }
+
+        DynamicBitset& operator&=(const DynamicBitset& other) {
+            for (size_t i = 0; i < words_.size(); i++) {
+                words_[i] &= other.words_[i];
+            }
+
+            return *this;
+        }
+
+        /**
+         * this |= other << shift, bits shifted past Size() are dropped.
+         * Sizes must be equal, other may be this
+         */
+        void OrShifted(const DynamicBitset& other, size_t shift) {
+            size_t word_shift = shift / WORD_BITS;
+            size_t bit_shift = shift % WORD_BITS;
+
+            // Descending order reads only words not updated yet
+            for (size_t i = words_.size(); i-- > word_shift;) {
+                size_t src = i - word_shift;
+                Word word = other.words_[src] << bit_shift;
+                if (bit_shift != 0 && src > 0) {
+                    word |= other.words_[src - 1] >> (WORD_BITS - bit_shift);
+                }
+
+                words_[i] |= word;
+            }
+
+            if (size_ % WORD_BITS != 0) {
+                words_.back() &= (Word(1) << (size_ % WORD_BITS)) - 1;
+            }
+        }
+
+        bool operator==(const DynamicBitset& other) const = default;
+
+        /**
+         * Calls func(pos) for every set bit in increasing order
+         */
+        template <typename Func>
+        void ForEach(Func func) const {
+            for (size_t i = 0; i < words_.size(); i++) {
+                Word word = words_[i];
+                while (word != 0) {
+                    func(i * WORD_BITS + std::countr_zero(word));
+                    word &= word - 1;
+                }
+            }
+        }
+
+        const Word* Data() const {
+            return words_.data();
+        }
+
+        Word* Data() {
+            return words_.data();
+        }
+
+        size_t Hash() const {
+            return HashWords(words_.data(), words_.size());
+        }
+
+        static size_t HashWords(const Word* words, size_t count) {
+            uint64_t hash = 0xcbf29ce484222325;
+            for (size_t i = 0; i < count; i++) {
+                hash = (hash ^ words[i]) * 0x100000001b3;
+                hash ^= hash >> 29;
+            }
+
+            return hash;
+        }
+
+    private:
+        std::vector<Word> words_;
+        size_t size_;
+    };
+
+    /**
+     * Open addressing set of equally sized bitsets, indexed in order of insertion.
+     * Bitsets are stored back to back in one flat array of words
+     */
+    class BitsetTable {
+    public:
+        using Word = DynamicBitset::Word;
+
+        explicit BitsetTable(size_t words) : words_(words), slots_(16, -1) {}
+
+        int Size() const {
+            return static_cast<int>(hashes_.size());
+        }
+
+        /// Pointer is invalidated by Insert
+        const Word* Get(int index) const {
+            return bitsets_.data() + index * words_;
+        }
+
+        /**
+         * @return Index of the bitset and whether it was inserted right now
+         */
+        std::pair<int, bool> Insert(const Word* bitset) {
+            return Insert(bitset, DynamicBitset::HashWords(bitset, words_));
+        }
+
+        std::pair<int, bool> Insert(const Word* bitset, size_t hash) {
+            size_t mask = slots_.size() - 1;
+            for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+                int index = slots_[slot];
+                if (index == -1) {
+                    index = Size();
+                    slots_[slot] = index;
+                    hashes_.push_back(hash);
+                    bitsets_.insert(bitsets_.end(), bitset, bitset + words_);
+
+                    if (hashes_.size() * 2 > slots_.size()) {
+                        Grow();
+                    }
+
+                    return { index, true };
+                }
+
+                if (hashes_[index] == hash && std::equal(bitset, bitset + words_, Get(index))) {
+                    return { index, false };
+                }
+            }
+        }
+
+        /// Forgets all bitsets, keeps allocated memory
+        void Clear() {
+            bitsets_.clear();
+            hashes_.clear();
+            std::fill(slots_.begin(), slots_.end(), -1);
+        }
+
+        /// Approximate heap usage in bytes
+        size_t GetMemoryUsage() const {
+            return bitsets_.capacity() * sizeof(Word) + hashes_.capacity() * sizeof(size_t) +
+                   slots_.capacity() * sizeof(int);
+        }
+
+    private:
+        void Grow() {
+            slots_.assign(slots_.size() * 2, -1);
+            size_t mask = slots_.size() - 1;
+            for (int index = 0; index < Size(); index++) {
+                size_t slot = hashes_[index] & mask;
+                while (slots_[slot] != -1) {
+                    slot = (slot + 1) & mask;
+                }
+
+                slots_[slot] = index;
+            }
+        }
+
+    private:
+        size_t words_;
+        std::vector<Word> bitsets_;
+        std::vector<size_t> hashes_;
+        std::vector<int> slots_;
+    };
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <libformal/automaton.hpp>
+#include <libformal/bitset.hpp>
+
+namespace formal {
+    /**
+     * Flat-table form of a finished DFA for fast membership tests.
+     * Transitions live in a dense (state x byte class) table, missing transitions lead to the dead
+     * row 0 which loops on itself, so a step is a class lookup and one table load, and only the latter
+     * depends on the previous step.
+     * The dead row is final if the DFA has an accepting implicit sink.
+     * DFAs of at most SHUFFLE_MAX_STATES states are also encoded as one 16-byte transition vector per letter,
+     * so on CPUs with SSSE3 a step is a single byte shuffle. The dead state counts only if some letter leads
+     * there from some states but not from all of them
+     */
+    class CompiledDFA {
+    public:
+        /// Table entries are row offsets (state index * classes count), not bare state indices
+        using RowOffset = int32_t;
+
+        static constexpr RowOffset DEAD_ROW = 0;
+
+        /// Count of words MatchBatch walks through the table at once
+        static constexpr int BATCH_LANES = 16;
+
+        /// Biggest states count for the shuffle engine
+        static constexpr int SHUFFLE_MAX_STATES = 16;
+
+        /// ParallelMatch does not split a word into chunks shorter than this
+        static constexpr size_t MIN_PARALLEL_CHUNK = 1 << 16;
+
+        /**
+         * @param dfa Automaton to compile. Must be IsDFA
+         * @throws std::length_error if states count times byte classes count does not fit into RowOffset
+         */
+        explicit CompiledDFA(const Automaton& dfa);
+
+        /**
+         * Tries to read given word
+         * @return True if word is accepted, false otherwise
+         */
+        bool Match(std::string_view word) const {
+            if (use_shuffle_) {
+                return IsFinalRow(RunShuffle(initial_row_, word));
+            }
+
+            const RowOffset* table = table_.data();
+            const uint8_t* classes = classes_.data();
+
+            RowOffset row = initial_row_;
+            for (char letter : word) {
+                row = table[row + classes[static_cast<unsigned char>(letter)]];
+            }
+
+            return IsFinalRow(row);
+        }
+
+        /**
+         * Matches many independent words at once. Steps of up to BATCH_LANES words are interleaved,
+         * so their table loads overlap instead of waiting for each other
+         * @return Bitset with i-th bit set iff words[i] is accepted
+         */
+        DynamicBitset MatchBatch(std::span<const std::string_view> words) const;
+
+        /**
+         * Matches one long word on several threads. The word is cut into chunks, every chunk except the first one
+         * is run from all states at once, and the resulting state mappings are composed in order.
+         * Runs from different states tend to converge quickly and are merged, still the work grows with
+         * the states count, so the DFA is better minimized first
+         * @param threads_count Count of chunks processed in parallel, values below 1 mean 1
+         * @return Same as Match(word)
+         */
+        bool ParallelMatch(std::string_view word, int threads_count) const;
+
+        int GetStatesCount() const {
+            return static_cast<int>(table_.size() / row_size_);
+        }
+
+        /// Length of a table row
+        int GetClassesCount() const {
+            return row_size_;
+        }
+
+        /// True if Match runs on byte shuffles instead of the table
+        bool UsesShuffleEngine() const {
+            return use_shuffle_;
+        }
+
+    private:
+        /**
+         * Reads given chunk starting from every state
+         * @return Row reached from each state, indexed by the state index
+         */
+        std::vector<RowOffset> RunFromAllStates(std::string_view chunk) const;
+
+        /// Reads given chunk from the given row on the shuffle engine
+        RowOffset RunShuffle(RowOffset row, std::string_view chunk) const;
+
+        /// Row of the state in the given shuffle lane
+        RowOffset LaneToRow(uint8_t lane) const;
+
+        bool IsFinalRow(RowOffset row) const {
+            int state = row / row_size_;
+            return (final_[state / 64] >> (state % 64)) & 1;
+        }
+
+    private:
+        std::vector<RowOffset> table_;
+        std::vector<uint64_t> final_;
+
+        /// Byte classes of the DFA, row_size_ of them
+        std::array<uint8_t, 256> classes_;
+        int row_size_;
+
+        RowOffset initial_row_;
+
+        /// Indexed by letter, i-th byte is the lane reached from the i-th lane. Empty unless use_shuffle_
+        std::vector<std::array<uint8_t, SHUFFLE_MAX_STATES>> shuffles_;
+        bool use_shuffle_;
+
+        /// State index of lane 0, 1 if the dead state has no lane
+        int shuffle_base_;
+    };
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <libformal/regexp_terms.hpp>
+
+namespace formal {
+    /**
+     * Matches words against a regexp via Antimirov partial derivatives, no automaton is compiled.
+     * A state is the set of derivative terms, states are built on the first visit and cached
+     * in a flat (state x 256) table, so only states a workload touches are ever built
+     */
+    class DerivativeMatcher {
+    public:
+        using StateIndex = int32_t;
+
+        static constexpr int ROW_SIZE = 256;
+        static constexpr StateIndex DEAD_STATE = 0;
+        /// Transition which is not built yet
+        static constexpr StateIndex UNKNOWN_STATE = -1;
+
+        /**
+         * @param regexp Regular expression in Reverse Polish Notation, throws RegExpProcessError if malformed
+         */
+        explicit DerivativeMatcher(const std::string& regexp);
+
+        /**
+         * Tries to read given word
+         * @return True if word is accepted, false otherwise
+         */
+        bool Match(std::string_view word) {
+            StateIndex state = initial_state_;
+            for (char letter : word) {
+                StateIndex next = table_[state * ROW_SIZE + static_cast<unsigned char>(letter)];
+                if (next == UNKNOWN_STATE) {
+                    next = Step(state, letter);
+                }
+
+                if (next == DEAD_STATE) {
+                    return false;
+                }
+
+                state = next;
+            }
+
+            return final_[state];
+        }
+
+        /// Including the dead state
+        int GetStatesCount() const {
+            return static_cast<int>(states_.size());
+        }
+
+        const RegExpTermPool& GetTermPool() const {
+            return pool_;
+        }
+
+    private:
+        /// Sorted set of terms
+        using TermSet = std::vector<TermId>;
+
+        StateIndex Step(StateIndex state, char letter);
+
+        /// Appends partial derivatives of term by letter to derivatives
+        void Derive(TermId term, char letter, TermSet& derivatives);
+
+        StateIndex AddState(TermSet terms);
+
+    private:
+        RegExpTermPool pool_;
+
+        std::vector<TermSet> states_;
+        std::map<TermSet, StateIndex> state_indices_;
+        std::vector<StateIndex> table_;
+        std::vector<uint8_t> final_;
+        StateIndex initial_state_;
+    };
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <libformal/automaton.hpp>
+#include <libformal/bitset.hpp>
+
+namespace formal {
+    /**
+     * Determinizes an NFA on the fly while matching.
+     * DFA states are built on the first visit and cached in a flat (state x 256) table, so matching
+     * cached states costs one table load per letter. When the cache does not fit in the memory budget
+     * it is flushed and matching goes on from the freshly built state
+     */
+    class LazyDFA {
+    public:
+        using StateIndex = int32_t;
+
+        static constexpr int ROW_SIZE = 256;
+        static constexpr StateIndex DEAD_STATE = 0;
+        /// Transition which is not built yet
+        static constexpr StateIndex UNKNOWN_STATE = -1;
+        static constexpr size_t DEFAULT_MEMORY_BUDGET = 8 << 20;
+
+        /**
+         * @param nfa Automaton to wrap. Must have defined initial state, no eps-transitions and
+         * all transitions must be single-letter. It is copied, so it may be changed or destroyed afterwards
+         * @param memory_budget Bytes the state cache may take. At least a few states are always kept
+         */
+        explicit LazyDFA(const Automaton& nfa, size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+        /**
+         * Tries to read given word
+         * @return True if word is accepted, false otherwise
+         */
+        bool Match(std::string_view word) {
+            StateIndex state = initial_state_;
+            for (char letter : word) {
+                StateIndex next = table_[state * ROW_SIZE + static_cast<unsigned char>(letter)];
+                if (next == UNKNOWN_STATE) {
+                    next = Step(state, static_cast<unsigned char>(letter));
+                }
+
+                state = next;
+            }
+
+            return final_[state];
+        }
+
+        /// Including the dead state
+        int GetCachedStatesCount() const {
+            return subsets_.Size();
+        }
+
+        int GetFlushesCount() const {
+            return flushes_count_;
+        }
+
+    private:
+        using Word = DynamicBitset::Word;
+
+        /// Builds the transition from state by letter, flushing the cache if needed
+        StateIndex Step(StateIndex state, unsigned char letter);
+
+        StateIndex AddState(const Word* subset);
+
+        /// Drops all states except the dead and the initial ones
+        void Reset();
+
+    private:
+        size_t words_;
+
+        /// NFA transitions of state with id i are edges_[edge_offsets_[i], edge_offsets_[i + 1])
+        std::vector<uint32_t> edge_offsets_;
+        TransitionList edges_;
+        DynamicBitset nfa_finals_;
+        StateId nfa_initial_;
+        bool dead_final_;
+
+        /// Subset with index i is represented by DFA state i
+        BitsetTable subsets_;
+        std::vector<StateIndex> table_;
+        std::vector<uint8_t> final_;
+        StateIndex initial_state_;
+
+        size_t max_states_;
+        int flushes_count_;
+
+        std::vector<Word> next_subset_;
+    };
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <libformal/automaton.hpp>
+#include <libformal/bitset.hpp>
+
+namespace formal {
+    /**
+     * Simulates an eps-free NFA without determinization, the set of current states is a bitset.
+     * A step ORs precomputed successor masks of the current states, so a word costs O(n * m / 64)
+     * for m states. Glushkov-style automata (all transitions into a state share the letter) need a single
+     * follow mask per state which is then filtered by the letter. Masks which don't fit in the memory budget
+     * are replaced by scattering transitions one by one
+     */
+    class NFAMatcher {
+    public:
+        static constexpr size_t DEFAULT_MASKS_BUDGET = 64 << 20;
+
+        /**
+         * @param nfa Automaton to wrap. Must have defined initial state, no eps-transitions and all transitions
+         * must be single-letter. Must not have an accepting implicit sink. It is copied,
+         * so it may be changed or destroyed afterwards
+         * @param masks_budget Bytes the successor masks may take
+         */
+        explicit NFAMatcher(const Automaton& nfa, size_t masks_budget = DEFAULT_MASKS_BUDGET);
+
+        /**
+         * Tries to read given word
+         * @return True if word is accepted, false otherwise
+         */
+        bool Match(std::string_view word) const;
+
+    private:
+        using Word = DynamicBitset::Word;
+
+        enum class StepMode {
+            /// follow_masks_ of the states filtered by letter_masks_
+            Follow,
+            /// successor_masks_ by (state, letter)
+            Successors,
+            /// Transitions one by one
+            Scatter
+        };
+
+        /// Computes dst from src by letter, dst is cleared beforehand
+        void Step(const Word* src, unsigned char letter, Word* dst) const;
+
+    private:
+        size_t words_;
+        StepMode mode_;
+
+        DynamicBitset initial_;
+        DynamicBitset finals_;
+
+        /// Follow mode: all targets of each state and states entered by each letter
+        std::vector<Word> follow_masks_;
+        std::vector<Word> letter_masks_;
+
+        /// Successors mode: mask for (state, letter index) pair, -1 index if letter is never used
+        std::vector<int> letter_indices_;
+        size_t letters_count_;
+        std::vector<Word> successor_masks_;
+
+        /// Scatter mode: transitions of state with id i are edges_[edge_offsets_[i], edge_offsets_[i + 1])
+        std::vector<uint32_t> edge_offsets_;
+        TransitionList edges_;
+    };
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string_view>
+#include <libformal/algorithms.hpp>
+#include <libformal/compiled_dfa.hpp>
+
+namespace formal {
+    /**
+     * Matches words against a product of two DFAs without building the product.
+     * Operands are compiled separately and the second one is skipped when the first one decides
+     */
+    class ProductMatcher {
+    public:
+        /**
+         * @param lhs Left operand. Must be IsDFA
+         * @param rhs Right operand. Must be IsDFA
+         */
+        ProductMatcher(const Automaton& lhs, const Automaton& rhs, ProductOperation operation) :
+            lhs_(lhs), rhs_(rhs), operation_(operation) {}
+
+        /**
+         * Tries to read given word
+         * @return True if word is accepted by the product, false otherwise
+         */
+        bool Match(std::string_view word) const {
+            bool in_lhs = lhs_.Match(word);
+            switch (operation_) {
+                case ProductOperation::Intersection:
+                case ProductOperation::Difference:
+                    if (!in_lhs) {
+                        return false;
+                    }
+
+                    return rhs_.Match(word) == (operation_ == ProductOperation::Intersection);
+
+                case ProductOperation::Union:
+                    return in_lhs || rhs_.Match(word);
+
+                case ProductOperation::SymmetricDifference:
+                    return in_lhs != rhs_.Match(word);
+            }
+
+            return false;
+        }
+
+    private:
+        CompiledDFA lhs_;
+        CompiledDFA rhs_;
+        ProductOperation operation_;
+    };
+}
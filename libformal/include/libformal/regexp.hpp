@@ -2,8 +2,12 @@
 
 #include <fmt/core.h>
 #include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace formal {
@@ -26,7 +30,7 @@ namespace formal {
 
     class DummyResult {};
 
-    class DummyRegExpWalker : public IRegExpWalker<DummyResult> {
+    class DummyRegExpWalker final : public IRegExpWalker<DummyResult> {
     public:
         DummyResult InstantiateEmptyResult() override { return DummyResult(); }
         DummyResult ProcessSingleLetter(char letter) override { return DummyResult(); };
@@ -36,75 +40,202 @@ namespace formal {
         DummyResult ProcessStar(DummyResult a) override { return DummyResult(); };
     };
 
-    template<typename Result>
-    Result ProcessRPNRegExp(const std::string& regexp, IRegExpWalker<Result>& algo) {
-        std::vector<Result> result_stack;
-        for (int pos = 0; pos < regexp.size(); pos++) {
-            char c = regexp[pos];
-
-            Result lhs = algo.InstantiateEmptyResult();
-            Result rhs = algo.InstantiateEmptyResult();
-            bool enough_args = true;
-
-            switch (c) {
-                case '+':
-                case '.':
-                    if (result_stack.size() < 2) {
-                        enough_args = false;
+    enum class RegExpNodeKind : uint8_t {
+        Letter,
+        Epsilon,
+        Union,
+        Concat,
+        Star
+    };
+
+    struct RegExpNode {
+        RegExpNodeKind kind;
+        /// Letter nodes only
+        char letter;
+        /// Operand indices, -1 if there is no such operand
+        int lhs;
+        int rhs;
+
+        bool operator==(const RegExpNode& other) const = default;
+    };
+
+    /**
+     * Regular expression parsed once into a contiguous arena of nodes.
+     * Structurally equal subexpressions share one node, so nodes form a DAG. Operands always precede
+     * their operator and the root is the last node. The tree itself is kept as the postfix sequence of node indices
+     */
+    class RegExpAst {
+    public:
+        /**
+         * @param regexp Regular expression in Reverse Polish Notation
+         * @throws RegExpProcessError if regexp is malformed
+         */
+        explicit RegExpAst(const std::string& regexp);
+
+        const std::vector<RegExpNode>& GetNodes() const {
+            return nodes_;
+        }
+
+        const RegExpNode& GetNode(int index) const {
+            return nodes_[index];
+        }
+
+        int GetRoot() const {
+            return static_cast<int>(nodes_.size()) - 1;
+        }
+
+        /// Node index for every symbol of the original regexp
+        const std::vector<int>& GetPostfix() const {
+            return postfix_;
+        }
+
+        /// Max count of intermediate results alive during a postfix evaluation
+        int GetMaxDepth() const {
+            return max_depth_;
+        }
+
+    private:
+        std::vector<RegExpNode> nodes_;
+        std::vector<int> postfix_;
+        int max_depth_;
+    };
+
+    template<typename Walker>
+    using RegExpWalkerResult = decltype(std::declval<Walker&>().ProcessEpsilon());
+
+    /**
+     * Anything with the Process* family of IRegExpWalker, no need for InstantiateEmptyResult.
+     * Walkers derived from IRegExpWalker should be final so that EvaluateRegExp calls them directly
+     */
+    template<typename Walker>
+    concept RegExpWalker = requires(Walker& walker, char letter, RegExpWalkerResult<Walker> a,
+                                    RegExpWalkerResult<Walker> b) {
+        { walker.ProcessSingleLetter(letter) } -> std::same_as<RegExpWalkerResult<Walker>>;
+        { walker.ProcessUnion(std::move(a), std::move(b)) } -> std::same_as<RegExpWalkerResult<Walker>>;
+        { walker.ProcessConcat(std::move(a), std::move(b)) } -> std::same_as<RegExpWalkerResult<Walker>>;
+        { walker.ProcessStar(std::move(a)) } -> std::same_as<RegExpWalkerResult<Walker>>;
+    };
+
+    /**
+     * Walker whose result for a subexpression depends only on that subexpression, so equal subexpressions
+     * may share it. Opted in by static constexpr bool SHAREABLE_RESULTS = true
+     */
+    template<typename Walker>
+    concept ShareableRegExpWalker = RegExpWalker<Walker> && Walker::SHAREABLE_RESULTS;
+
+    /**
+     * Walks parsed regexp bottom-up. Operands are moved into their operator, nothing is instantiated in advance.
+     * Shareable walkers process every distinct subexpression once, results of shared ones are copied
+     * to all but the last of their operators. Other walkers process the whole tree
+     */
+    template<RegExpWalker Walker>
+    RegExpWalkerResult<Walker> EvaluateRegExp(const RegExpAst& regexp, Walker& walker) {
+        using Result = RegExpWalkerResult<Walker>;
+
+        if constexpr (ShareableRegExpWalker<Walker>) {
+            const std::vector<RegExpNode>& nodes = regexp.GetNodes();
+
+            // Count of operators yet to take the result of each node
+            std::vector<int> uses(nodes.size(), 0);
+            for (const RegExpNode& node : nodes) {
+                if (node.lhs != -1) {
+                    uses[node.lhs]++;
+                }
+
+                if (node.rhs != -1) {
+                    uses[node.rhs]++;
+                }
+            }
+
+            std::vector<std::optional<Result>> results(nodes.size());
+            auto take = [&](int index) -> Result {
+                if (--uses[index] > 0) {
+                    return *results[index];
+                }
+
+                Result result = std::move(*results[index]);
+                results[index].reset();
+                return result;
+            };
+
+            for (size_t index = 0; index < nodes.size(); index++) {
+                const RegExpNode& node = nodes[index];
+                switch (node.kind) {
+                    case RegExpNodeKind::Letter:
+                        results[index].emplace(walker.ProcessSingleLetter(node.letter));
                         break;
-                    }
 
-                    rhs = std::move(result_stack.back());
-                    result_stack.pop_back();
-                    lhs = std::move(result_stack.back());
-                    result_stack.pop_back();
-                    break;
+                    case RegExpNodeKind::Epsilon:
+                        results[index].emplace(walker.ProcessEpsilon());
+                        break;
+
+                    case RegExpNodeKind::Union:
+                    case RegExpNodeKind::Concat: {
+                        Result lhs = take(node.lhs);
+                        Result rhs = take(node.rhs);
+
+                        if (node.kind == RegExpNodeKind::Union) {
+                            results[index].emplace(walker.ProcessUnion(std::move(lhs), std::move(rhs)));
+                        } else {
+                            results[index].emplace(walker.ProcessConcat(std::move(lhs), std::move(rhs)));
+                        }
 
-                case '*':
-                    if (result_stack.empty()) {
-                        enough_args = false;
                         break;
                     }
 
-                    lhs = std::move(result_stack.back());
-                    result_stack.pop_back();
-                    break;
-
-                default:
-                    break;
+                    case RegExpNodeKind::Star:
+                        results[index].emplace(walker.ProcessStar(take(node.lhs)));
+                        break;
+                }
             }
 
-            if (!enough_args) {
-                throw RegExpProcessError(fmt::format("not enough operands for operation {} at pos {}", c, pos + 1));
-            }
+            return std::move(*results[regexp.GetRoot()]);
+        } else {
+            std::vector<Result> result_stack;
+            result_stack.reserve(regexp.GetMaxDepth());
+            for (int index : regexp.GetPostfix()) {
+                const RegExpNode& node = regexp.GetNode(index);
+                switch (node.kind) {
+                    case RegExpNodeKind::Letter:
+                        result_stack.push_back(walker.ProcessSingleLetter(node.letter));
+                        break;
 
-            switch (c) {
-                case '1':
-                    result_stack.push_back(algo.ProcessEpsilon());
-                    break;
+                    case RegExpNodeKind::Epsilon:
+                        result_stack.push_back(walker.ProcessEpsilon());
+                        break;
 
-                case '+':
-                    result_stack.push_back(algo.ProcessUnion(std::move(lhs), std::move(rhs)));
-                    break;
+                    case RegExpNodeKind::Union:
+                    case RegExpNodeKind::Concat: {
+                        Result rhs = std::move(result_stack.back());
+                        result_stack.pop_back();
+                        Result lhs = std::move(result_stack.back());
+                        result_stack.pop_back();
 
-                case '.':
-                    result_stack.push_back(algo.ProcessConcat(std::move(lhs), std::move(rhs)));
-                    break;
+                        if (node.kind == RegExpNodeKind::Union) {
+                            result_stack.push_back(walker.ProcessUnion(std::move(lhs), std::move(rhs)));
+                        } else {
+                            result_stack.push_back(walker.ProcessConcat(std::move(lhs), std::move(rhs)));
+                        }
 
-                case '*':
-                    result_stack.push_back(algo.ProcessStar(std::move(lhs)));
-                    break;
+                        break;
+                    }
 
-                default:
-                    result_stack.push_back(algo.ProcessSingleLetter(c));
-                    break;
+                    case RegExpNodeKind::Star: {
+                        Result lhs = std::move(result_stack.back());
+                        result_stack.pop_back();
+                        result_stack.push_back(walker.ProcessStar(std::move(lhs)));
+                        break;
+                    }
+                }
             }
-        }
 
-        if (result_stack.size() > 1) {
-            throw RegExpProcessError("unused operands were left");
+            assert(result_stack.size() == 1);
+            return std::move(result_stack.back());
         }
+    }
 
-        return result_stack.back();
+    template<typename Result>
+    Result ProcessRPNRegExp(const std::string& regexp, IRegExpWalker<Result>& algo) {
+        return EvaluateRegExp(RegExpAst(regexp), algo);
     }
-}
\ No newline at end of file
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <array>
 #include <climits>
+#include <libformal/alphabet.hpp>
+#include <libformal/automaton.hpp>
+#include <libformal/bitset.hpp>
 #include <libformal/regexp.hpp>
 #include <vector>
 
@@ -18,13 +22,18 @@ namespace formal {
      */
     int GetPrefixedMin(const std::string& regexp, char letter, int count);
 
+    /**
+     * Same as above for already parsed regular expression
+     */
+    int GetPrefixedMin(const RegExpAst& regexp, char letter, int count);
+
     struct PrefixedMinResult {
         /// Min length of word of type x^n.w accepted by regexp for each n = [0;count]
         std::vector<int> min_prefixed_len;
         /// Is word x^n accepted by regexp for each n = [0;count]
-        std::vector<bool> has_prefix;
+        DynamicBitset has_prefix;
 
-        PrefixedMinResult(int count) : min_prefixed_len(count + 1, INT_NONE), has_prefix(count + 1, false) {}
+        PrefixedMinResult(int count) : min_prefixed_len(count + 1, INT_NONE), has_prefix(count + 1) {}
 
         PrefixedMinResult(const PrefixedMinResult& other) = default;
         PrefixedMinResult(PrefixedMinResult&& other) = default;
@@ -33,8 +42,10 @@ namespace formal {
         PrefixedMinResult& operator=(PrefixedMinResult&& other) = default;
     };
 
-    class PrefixedMinWalker : public IRegExpWalker<PrefixedMinResult> {
+    class PrefixedMinWalker final : public IRegExpWalker<PrefixedMinResult> {
     public:
+        static constexpr bool SHAREABLE_RESULTS = true;
+
         PrefixedMinWalker(char pref_letter, int count) : pref_letter_(pref_letter), count_(count) {}
 
         PrefixedMinResult InstantiateEmptyResult() override {
@@ -51,4 +62,145 @@ namespace formal {
         char pref_letter_;
         int count_;
     };
+
+    /**
+     * Answers of GetPrefixedMin for every letter and every k up to a shared count
+     */
+    class PrefixedMinTable {
+    public:
+        PrefixedMinTable(LetterSet letters, int count, int shortest, std::vector<int> table);
+
+        /**
+         * \param letter Any letter, the ones absent in regexp are fine too
+         * \param count Value k, at most GetCount()
+         * \return Same as GetPrefixedMin(regexp, letter, count)
+         */
+        int Get(char letter, int count) const {
+            if (!letters_.Contains(letter)) {
+                return count == 0 ? shortest_ : INT_NONE;
+            }
+
+            return table_[letter_indices_[static_cast<unsigned char>(letter)] * (count_ + 1) + count];
+        }
+
+        int GetCount() const {
+            return count_;
+        }
+
+        /// Letters of regexp, other letters can't start a word
+        const LetterSet& GetLetters() const {
+            return letters_;
+        }
+
+    private:
+        LetterSet letters_;
+        std::array<int, 256> letter_indices_;
+        int count_;
+        /// Length of the shortest word, the answer for k = 0 and any letter
+        int shortest_;
+        /// Row of count + 1 values for each letter in increasing order
+        std::vector<int> table_;
+    };
+
+    /**
+     * Computes GetPrefixedMin for all letters of regexp and all k in [0; count] in a single walk
+     *
+     * \param regexp Regular expression in Reverse Polish Notation
+     * \param count Max value of k
+     */
+    PrefixedMinTable GetPrefixedMinTable(const std::string& regexp, int count);
+
+    /**
+     * Same as above for already parsed regular expression
+     */
+    PrefixedMinTable GetPrefixedMinTable(const RegExpAst& regexp, int count);
+
+    /**
+     * Runs a PrefixedMinWalker for each of given letters at once.
+     * Result holds one PrefixedMinResult per letter, in increasing order of letters
+     */
+    class AllLettersPrefixedMinWalker final {
+    public:
+        using Result = std::vector<PrefixedMinResult>;
+
+        static constexpr bool SHAREABLE_RESULTS = true;
+
+        AllLettersPrefixedMinWalker(const LetterSet& letters, int count);
+
+        Result ProcessSingleLetter(char letter);
+        Result ProcessEpsilon();
+        Result ProcessUnion(Result a, Result b);
+        Result ProcessConcat(Result a, Result b);
+        Result ProcessStar(Result a);
+
+    private:
+        std::vector<PrefixedMinWalker> walkers_;
+    };
+
+    enum class NFAConstruction {
+        /// Position automaton: one state per letter occurrence plus the initial one, no eps-transitions
+        Glushkov,
+        /// Two states per operator glued by eps-transitions
+        Thompson
+    };
+
+    /**
+     * Builds NFA accepting the language of regular expression
+     *
+     * \param regexp Regular expression in Reverse Polish Notation
+     * \param construction Construction to use
+     * \return Automaton over letters of regexp
+     */
+    Automaton RegExpToNFA(const std::string& regexp, NFAConstruction construction = NFAConstruction::Glushkov);
+
+    /**
+     * Same as above for already parsed regular expression
+     */
+    Automaton RegExpToNFA(const RegExpAst& regexp, NFAConstruction construction = NFAConstruction::Glushkov);
+
+    struct NFAFragment {
+        /// Glushkov: positions words of the fragment may start and end with.
+        /// Thompson: single entry and single exit state
+        std::vector<StateId> first;
+        std::vector<StateId> last;
+        /// Glushkov only: does fragment accept the empty word
+        bool nullable = false;
+    };
+
+    /**
+     * Emits states and transitions straight into given automaton while regexp is walked.
+     * Finish must be called with the walk result to set initial and final states
+     */
+    class RegExpToNFAWalker final : public IRegExpWalker<NFAFragment> {
+    public:
+        RegExpToNFAWalker(Automaton& automaton, NFAConstruction construction);
+
+        NFAFragment InstantiateEmptyResult() override {
+            return NFAFragment();
+        }
+
+        NFAFragment ProcessSingleLetter(char letter) override;
+        NFAFragment ProcessEpsilon() override;
+        NFAFragment ProcessUnion(NFAFragment a, NFAFragment b) override;
+        NFAFragment ProcessConcat(NFAFragment a, NFAFragment b) override;
+        NFAFragment ProcessStar(NFAFragment a) override;
+
+        void Finish(const NFAFragment& result);
+
+    private:
+        /// Glushkov: every transition from each of sources to each of targets, by the letter of target
+        void Connect(const std::vector<StateId>& sources, const std::vector<StateId>& targets);
+
+        /// Thompson: fragment from new entry to new exit
+        NFAFragment NewThompsonFragment();
+
+    private:
+        Automaton& automaton_;
+        NFAConstruction construction_;
+
+        /// Glushkov: the only non-position state
+        AutomatonState* initial_state_;
+        /// Glushkov: letter of each position, indexed by StateId
+        std::vector<SymbolId> position_letters_;
+    };
 };
\ No newline at end of file
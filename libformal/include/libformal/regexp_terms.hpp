@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <libformal/regexp.hpp>
+
+namespace formal {
+    using TermId = uint32_t;
+
+    enum class TermKind : uint8_t {
+        /// Empty language
+        Empty,
+        Epsilon,
+        Letter,
+        Union,
+        Concat,
+        Star
+    };
+
+    struct RegExpTerm {
+        TermKind kind;
+        char letter;
+        TermId lhs;
+        TermId rhs;
+        /// Does the term accept the empty word
+        bool nullable;
+
+        bool operator==(const RegExpTerm& other) const = default;
+    };
+
+    /**
+     * Hash-consed regexp terms: structurally equal terms share one id, so terms compare by id.
+     * Constructors apply cheap simplifications (units, zeros, idempotent union, r** = r*)
+     */
+    class RegExpTermPool {
+    public:
+        RegExpTermPool();
+
+        TermId Empty() const {
+            return EMPTY_TERM;
+        }
+
+        TermId Epsilon() const {
+            return EPSILON_TERM;
+        }
+
+        TermId Letter(char letter);
+        TermId Union(TermId a, TermId b);
+        TermId Concat(TermId a, TermId b);
+        TermId Star(TermId a);
+
+        const RegExpTerm& Get(TermId term) const {
+            return terms_[term];
+        }
+
+        bool IsNullable(TermId term) const {
+            return terms_[term].nullable;
+        }
+
+        size_t Size() const {
+            return terms_.size();
+        }
+
+    private:
+        static constexpr TermId EMPTY_TERM = 0;
+        static constexpr TermId EPSILON_TERM = 1;
+
+        struct TermHash {
+            size_t operator()(const RegExpTerm& term) const {
+                uint64_t hash = static_cast<uint64_t>(term.kind) * 0x9e3779b97f4a7c15 + static_cast<uint8_t>(term.letter);
+                hash = (hash ^ term.lhs) * 0x100000001b3;
+                hash = (hash ^ term.rhs) * 0x100000001b3;
+                return hash ^ (hash >> 29);
+            }
+        };
+
+        TermId Intern(RegExpTerm term);
+
+    private:
+        std::vector<RegExpTerm> terms_;
+        std::unordered_map<RegExpTerm, TermId, TermHash> ids_;
+    };
+
+    /**
+     * Builds hash-consed terms of a regexp
+     */
+    class RegExpTermWalker final : public IRegExpWalker<TermId> {
+    public:
+        static constexpr bool SHAREABLE_RESULTS = true;
+
+        explicit RegExpTermWalker(RegExpTermPool& pool) : pool_(pool) {}
+
+        TermId InstantiateEmptyResult() override {
+            return pool_.Empty();
+        }
+
+        TermId ProcessSingleLetter(char letter) override {
+            return pool_.Letter(letter);
+        }
+
+        TermId ProcessEpsilon() override {
+            return pool_.Epsilon();
+        }
+
+        TermId ProcessUnion(TermId a, TermId b) override {
+            return pool_.Union(a, b);
+        }
+
+        TermId ProcessConcat(TermId a, TermId b) override {
+            return pool_.Concat(a, b);
+        }
+
+        TermId ProcessStar(TermId a) override {
+            return pool_.Star(a);
+        }
+
+    private:
+        RegExpTermPool& pool_;
+    };
+}
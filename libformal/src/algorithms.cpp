@@ -1,143 +1,1251 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <deque>
 #include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
 #include <unordered_map>
 #include <unordered_set>
 #include <set>
-#include <queue>
+#include <thread>
+#include <tuple>
 #include <fmt/core.h>
 #include <libformal/automaton_state.hpp>
 #include <libformal/algorithms.hpp>
+#include <libformal/bitset.hpp>
+#include <libformal/nfa_matcher.hpp>
 
 namespace formal {
     namespace {
-        using StateSet = std::unordered_set<AutomatonState*>;
-        using StatewiseSet = std::unordered_map<AutomatonState*, StateSet>;
-
         uint64_t PtrToIndex(AutomatonState* state) {
             return reinterpret_cast<uint64_t>(state);
         }
 
-        void BuildEpsClosure(Automaton& automaton, AutomatonState* state, StatewiseSet& closures) {
-            if (closures.find(state) != closures.end()) {
+        /// Eps-transitions of the state, they are contiguous since edges are sorted by symbol
+        std::pair<TransitionList::const_iterator, TransitionList::const_iterator> EpsEdges(const AutomatonState* state) {
+            const TransitionList& edges = state->GetEdges();
+            return { std::lower_bound(edges.begin(), edges.end(), Transition{ EPS_SYMBOL, 0 }),
+                     std::lower_bound(edges.begin(), edges.end(), Transition{ EPS_SYMBOL + 1, 0 }) };
+        }
+
+        /**
+         * Used by RemoveEpsTransitions. Iterative Tarjan's algorithm over eps-transitions
+         * @return Component for every StateId (-1 for removed ids). Components are numbered in reverse
+         * topological order: eps-transitions lead to the same or lower numbered components only
+         */
+        std::vector<int> FindEpsComponents(const Automaton& automaton, int& components_count) {
+            StateId bound = automaton.GetStateIdBound();
+            std::vector<int> components(bound, -1);
+            std::vector<int> order(bound, -1);
+            std::vector<int> low(bound, 0);
+
+            struct Frame {
+                StateId id;
+                size_t edge;
+            };
+
+            std::vector<Frame> calls;
+            std::vector<StateId> component_stack;
+            int counter = 0;
+            components_count = 0;
+
+            auto enter = [&](StateId id) {
+                order[id] = low[id] = counter++;
+                component_stack.push_back(id);
+                calls.push_back({ id, 0 });
+            };
+
+            for (AutomatonState* root : automaton.GetStates()) {
+                if (order[root->GetNodeId()] != -1) {
+                    continue;
+                }
+
+                enter(root->GetNodeId());
+                while (!calls.empty()) {
+                    Frame& frame = calls.back();
+                    auto [eps_begin, eps_end] = EpsEdges(automaton.GetState(frame.id));
+
+                    if (frame.edge < static_cast<size_t>(eps_end - eps_begin)) {
+                        StateId dst_id = eps_begin[frame.edge++].target;
+                        if (order[dst_id] == -1) {
+                            enter(dst_id);
+                        } else if (components[dst_id] == -1) {
+                            low[frame.id] = std::min(low[frame.id], order[dst_id]);
+                        }
+
+                        continue;
+                    }
+
+                    StateId id = frame.id;
+                    calls.pop_back();
+                    if (!calls.empty()) {
+                        low[calls.back().id] = std::min(low[calls.back().id], low[id]);
+                    }
+
+                    if (low[id] == order[id]) {
+                        StateId member;
+                        do {
+                            member = component_stack.back();
+                            component_stack.pop_back();
+                            components[member] = components_count;
+                        } while (member != id);
+
+                        components_count++;
+                    }
+                }
+            }
+
+            return components;
+        }
+
+        /// Just DFS routine, visited is indexed by StateId
+        void AutomatonWalk(Automaton& automaton, AutomatonState* state, std::vector<bool>& visited) {
+            if (visited[state->GetNodeId()]) {
                 return;
             }
 
-            auto& closure = closures[state];
-            closure.insert(state);
-            for (auto& [word, dst_state] : state->GetTransitions()) {
-                if (word.empty()) {
-                    BuildEpsClosure(automaton, dst_state, closures);
-                    closure.insert(closures[dst_state].begin(), closures[dst_state].end());
+            // Explicit stack, long chains don't fit in the call stack
+            std::vector<AutomatonState*> stack = { state };
+            visited[state->GetNodeId()] = true;
+            while (!stack.empty()) {
+                AutomatonState* curr_state = stack.back();
+                stack.pop_back();
+
+                for (Transition transition : curr_state->GetEdges()) {
+                    if (!visited[transition.target]) {
+                        visited[transition.target] = true;
+                        stack.push_back(automaton.GetState(transition.target));
+                    }
                 }
             }
         }
 
-        /// RemoveEpsTransitions step for the single node
-        void EpsShortcutify(Automaton &automaton, AutomatonState* state, StatewiseSet& eps_closures) {
-            assert(automaton.Belongs(state));
+        using Word = DynamicBitset::Word;
 
-            // Calculate eps closure
-            BuildEpsClosure(automaton, state, eps_closures);
+        /// Used by DFA builder, subset is a bitset over NFA StateIds
+        std::string GenSetLabel(const Automaton& automaton, const Word* subset, size_t words) {
+            std::string label = "[";
+            for (size_t i = 0; i < words; i++) {
+                for (Word word = subset[i]; word != 0; word &= word - 1) {
+                    label.append(automaton.GetState(i * DynamicBitset::WORD_BITS + std::countr_zero(word))->GetLabel());
+                    label.append(", ");
+                }
+            }
 
-            // Add shortcuts & mark current state as final if necessary
-            auto& eps_closure = eps_closures[state];
-            for (AutomatonState* cls_state : eps_closure) {
-                if (cls_state->IsFinal()) {
-                    state->MarkAsFinal();
+            label.resize(label.size() - 2);
+            label.append("]");
+            return label;
+        }
+
+        /// Precomputed per-(state, letter) successor masks are used while they fit in this budget
+        const size_t SUCCESSOR_MASKS_BUDGET = 64 << 20;
+
+        /**
+         * Used by DFA builders. Computes successors of NFA subsets (bitsets over StateIds) by every letter at once
+         */
+        class SubsetSuccessors {
+        public:
+            explicit SubsetSuccessors(const Automaton& nfa) :
+                nfa_(nfa), words_(DynamicBitset::WordsCount(nfa.GetStateIdBound())), letter_indices_(EPS_SYMBOL, -1),
+                finals_(nfa.GetStateIdBound()) {
+                for (AutomatonState* state : nfa.GetStates()) {
+                    for (Transition transition : state->GetEdges()) {
+                        if (letter_indices_[transition.symbol] == -1) {
+                            letter_indices_[transition.symbol] = 0;
+                            letters_.push_back(transition.symbol);
+                        }
+                    }
+
+                    if (state->IsFinal()) {
+                        finals_.Set(state->GetNodeId());
+                    }
+                }
+
+                std::sort(letters_.begin(), letters_.end());
+                for (size_t i = 0; i < letters_.size(); i++) {
+                    letter_indices_[letters_[i]] = i;
+                }
+
+                // Successors are ORs of per-(state, letter) masks if they fit in memory
+                // and are scattered bit by bit otherwise
+                size_t masks_size = nfa.GetStateIdBound() * letters_.size() * words_;
+                if (masks_size * sizeof(Word) > SUCCESSOR_MASKS_BUDGET) {
+                    return;
                 }
 
-                for (auto& [word, dst_state] : cls_state->GetTransitions()) {
-                    if (!word.empty()) {
-                        state->AddTransition(word, dst_state);
+                successor_masks_.assign(masks_size, 0);
+                for (AutomatonState* state : nfa.GetStates()) {
+                    for (Transition transition : state->GetEdges()) {
+                        size_t mask_pos = (state->GetNodeId() * letters_.size() + letter_indices_[transition.symbol]) * words_;
+                        successor_masks_[mask_pos + transition.target / DynamicBitset::WORD_BITS] |=
+                            Word(1) << (transition.target % DynamicBitset::WORD_BITS);
                     }
                 }
             }
 
-            // Remove eps transitions from current state (they aren't need anymore)
-            // Yes, we need a copy
-            auto old_transitions = state->GetTransitions();
-            for (auto& [word, dst_state] : old_transitions) {
-                if (word.empty()) {
-                    state->RemoveTransition("", dst_state);
+            size_t GetWords() const {
+                return words_;
+            }
+
+            /// Sorted letters which have any transition
+            const std::vector<SymbolId>& GetLetters() const {
+                return letters_;
+            }
+
+            /**
+             * @param dst Successors by i-th letter are put to dst[i * GetWords(), (i + 1) * GetWords())
+             */
+            void Compute(const Word* subset, Word* dst) const {
+                size_t dst_size = letters_.size() * words_;
+                std::fill(dst, dst + dst_size, 0);
+
+                for (size_t i = 0; i < words_; i++) {
+                    for (Word word = subset[i]; word != 0; word &= word - 1) {
+                        StateId nfa_state = i * DynamicBitset::WORD_BITS + std::countr_zero(word);
+
+                        if (!successor_masks_.empty()) {
+                            const Word* masks = successor_masks_.data() + nfa_state * dst_size;
+                            for (size_t j = 0; j < dst_size; j++) {
+                                dst[j] |= masks[j];
+                            }
+                        } else {
+                            for (Transition transition : nfa_.GetState(nfa_state)->GetEdges()) {
+                                dst[letter_indices_[transition.symbol] * words_ +
+                                    transition.target / DynamicBitset::WORD_BITS] |=
+                                    Word(1) << (transition.target % DynamicBitset::WORD_BITS);
+                            }
+                        }
+                    }
+                }
+            }
+
+            bool IsFinal(const Word* subset) const {
+                for (size_t i = 0; i < words_; i++) {
+                    if ((subset[i] & finals_.Data()[i]) != 0) {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            bool IsEmpty(const Word* subset) const {
+                return std::all_of(subset, subset + words_, [](Word word) { return word == 0; });
+            }
+
+        private:
+            const Automaton& nfa_;
+            size_t words_;
+
+            std::vector<int> letter_indices_;
+            std::vector<SymbolId> letters_;
+
+            DynamicBitset finals_;
+            std::vector<Word> successor_masks_;
+        };
+
+        /**
+         * Used by parallel DFA builder. Subset table split into independently locked shards,
+         * global subset indices are given in order of insertion
+         */
+        class ConcurrentSubsetTable {
+        public:
+            static constexpr int SHARDS_COUNT = 64;
+
+            explicit ConcurrentSubsetTable(size_t words) : words_(words), size_(0) {
+                for (int i = 0; i < SHARDS_COUNT; i++) {
+                    shards_.push_back(std::make_unique<Shard>(words));
+                }
+            }
+
+            int Size() const {
+                return size_.load();
+            }
+
+            std::pair<int, bool> Insert(const Word* subset) {
+                size_t hash = DynamicBitset::HashWords(subset, words_);
+                // Shard by high bits, the shard table probes by low ones
+                Shard& shard = *shards_[(hash >> 32) % SHARDS_COUNT];
+
+                std::lock_guard<std::mutex> guard(shard.mutex);
+                auto [local_index, inserted] = shard.table.Insert(subset, hash);
+                if (inserted) {
+                    shard.indices.push_back(size_.fetch_add(1));
+                }
+
+                return { shard.indices[local_index], inserted };
+            }
+
+        private:
+            struct Shard {
+                explicit Shard(size_t words) : table(words) {}
+
+                std::mutex mutex;
+                BitsetTable table;
+                /// Global index for each local one
+                std::vector<int> indices;
+            };
+
+            size_t words_;
+            std::vector<std::unique_ptr<Shard>> shards_;
+            std::atomic<int> size_;
+        };
+
+        /// Used by parallel DFA builder
+        struct SubsetTask {
+            int index;
+            std::vector<Word> subset;
+        };
+
+        /**
+         * Used by parallel DFA builder. The owner works at the back, thieves take from the front
+         */
+        class WorkStealingQueue {
+        public:
+            void Push(SubsetTask task) {
+                std::lock_guard<std::mutex> guard(mutex_);
+                tasks_.push_back(std::move(task));
+            }
+
+            bool Pop(SubsetTask& task) {
+                std::lock_guard<std::mutex> guard(mutex_);
+                if (tasks_.empty()) {
+                    return false;
+                }
+
+                task = std::move(tasks_.back());
+                tasks_.pop_back();
+                return true;
+            }
+
+            bool Steal(SubsetTask& task) {
+                std::lock_guard<std::mutex> guard(mutex_);
+                if (tasks_.empty()) {
+                    return false;
+                }
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+                return true;
+            }
+
+        private:
+            std::mutex mutex_;
+            std::deque<SubsetTask> tasks_;
+        };
+
+        /// Used by parallel DFA builder. What a worker has found out about a subset
+        struct SubsetInfo {
+            int index;
+            bool final;
+            std::string label;
+        };
+
+        /// Used by parallel DFA builder
+        struct SubsetEdge {
+            int src_index;
+            int letter;
+            int dst_index;
+        };
+
+        /// Used by TransformToDFA. Sequential BFS in order of subsets discovery
+        void BuildDFASequential(const Automaton& nfa, const SubsetSuccessors& successors, Automaton& dfa) {
+            size_t words = successors.GetWords();
+            const std::vector<SymbolId>& letters = successors.GetLetters();
+
+            // Subset with index i is represented by DFA state with id i
+            BitsetTable subsets(words);
+
+            auto add_dfa_state = [&](const Word* subset) {
+                AutomatonState* dfa_state = dfa.InsertState();
+                dfa_state->SetLabel(GenSetLabel(nfa, subset, words));
+                if (successors.IsFinal(subset)) {
+                    dfa_state->MarkAsFinal();
+                }
+
+                return dfa_state;
+            };
+
+            DynamicBitset init_subset(nfa.GetStateIdBound());
+            init_subset.Set(nfa.GetInitialState()->GetNodeId());
+            subsets.Insert(init_subset.Data());
+            add_dfa_state(init_subset.Data())->MarkAsInitial();
+
+            std::vector<Word> curr_subset(words);
+            std::vector<Word> dst_subsets(letters.size() * words);
+            for (int curr_index = 0; curr_index < subsets.Size(); curr_index++) {
+                std::copy(subsets.Get(curr_index), subsets.Get(curr_index) + words, curr_subset.begin());
+                successors.Compute(curr_subset.data(), dst_subsets.data());
+
+                for (size_t letter = 0; letter < letters.size(); letter++) {
+                    const Word* dst_subset = dst_subsets.data() + letter * words;
+                    if (successors.IsEmpty(dst_subset)) {
+                        continue;
+                    }
+
+                    auto [dst_index, inserted] = subsets.Insert(dst_subset);
+                    if (inserted) {
+                        add_dfa_state(dst_subset);
+                    }
+
+                    dfa.GetState(curr_index)->AddTransition(letters[letter], dfa.GetState(dst_index));
                 }
             }
         }
 
-        /// Just DFS routine
-        void AutomatonWalk(Automaton& automaton, AutomatonState* state, StateSet& visited) {
-            if (visited.find(state) != visited.end()) {
-                return;
+        /**
+         * Used by TransformToDFA. Workers expand subsets taken from work-stealing queues and deduplicate them
+         * through the sharded table. The result is renumbered in BFS order, so it is identical to the sequential one
+         */
+        void BuildDFAParallel(const Automaton& nfa, const SubsetSuccessors& successors, Automaton& dfa,
+                              int threads_count) {
+            size_t words = successors.GetWords();
+            const std::vector<SymbolId>& letters = successors.GetLetters();
+
+            ConcurrentSubsetTable subsets(words);
+            std::vector<WorkStealingQueue> queues(threads_count);
+            std::vector<std::vector<SubsetInfo>> infos(threads_count);
+            std::vector<std::vector<SubsetEdge>> edges(threads_count);
+
+            // Tasks which are created but not finished yet
+            std::atomic<int64_t> pending(1);
+
+            SubsetTask init_task{ 0, std::vector<Word>(words, 0) };
+            StateId nfa_init_id = nfa.GetInitialState()->GetNodeId();
+            init_task.subset[nfa_init_id / DynamicBitset::WORD_BITS] |= Word(1) << (nfa_init_id % DynamicBitset::WORD_BITS);
+            subsets.Insert(init_task.subset.data());
+            infos[0].push_back({ 0, successors.IsFinal(init_task.subset.data()),
+                                 GenSetLabel(nfa, init_task.subset.data(), words) });
+            queues[0].Push(std::move(init_task));
+
+            auto worker = [&](int worker_id) {
+                std::vector<Word> dst_subsets(letters.size() * words);
+                SubsetTask task;
+
+                while (true) {
+                    bool found = queues[worker_id].Pop(task);
+                    for (int i = 1; i < threads_count && !found; i++) {
+                        found = queues[(worker_id + i) % threads_count].Steal(task);
+                    }
+
+                    if (!found) {
+                        if (pending.load() == 0) {
+                            return;
+                        }
+
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    successors.Compute(task.subset.data(), dst_subsets.data());
+                    for (size_t letter = 0; letter < letters.size(); letter++) {
+                        const Word* dst_subset = dst_subsets.data() + letter * words;
+                        if (successors.IsEmpty(dst_subset)) {
+                            continue;
+                        }
+
+                        auto [dst_index, inserted] = subsets.Insert(dst_subset);
+                        if (inserted) {
+                            infos[worker_id].push_back({ dst_index, successors.IsFinal(dst_subset),
+                                                         GenSetLabel(nfa, dst_subset, words) });
+
+                            pending.fetch_add(1);
+                            queues[worker_id].Push({ dst_index, std::vector<Word>(dst_subset, dst_subset + words) });
+                        }
+
+                        edges[worker_id].push_back({ task.index, static_cast<int>(letter), dst_index });
+                    }
+
+                    pending.fetch_sub(1);
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (int i = 0; i < threads_count; i++) {
+                threads.emplace_back(worker, i);
             }
 
-            visited.insert(state);
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
 
-            for (auto& [word, dst_state] : state->GetTransitions()) {
-                AutomatonWalk(automaton, dst_state, visited);
+            int subsets_count = subsets.Size();
+            std::vector<int> table(subsets_count * letters.size(), -1);
+            for (auto& worker_edges : edges) {
+                for (SubsetEdge edge : worker_edges) {
+                    table[edge.src_index * letters.size() + edge.letter] = edge.dst_index;
+                }
+            }
+
+            std::vector<SubsetInfo*> info_by_index(subsets_count);
+            for (auto& worker_infos : infos) {
+                for (SubsetInfo& info : worker_infos) {
+                    info_by_index[info.index] = &info;
+                }
+            }
+
+            // Renumber in BFS order with letters ascending, just like the sequential builder does
+            std::vector<AutomatonState*> dfa_states(subsets_count, nullptr);
+            std::vector<int> order = { 0 };
+            auto add_dfa_state = [&](int index) {
+                AutomatonState* dfa_state = dfa.InsertState();
+                dfa_state->SetLabel(std::move(info_by_index[index]->label));
+                if (info_by_index[index]->final) {
+                    dfa_state->MarkAsFinal();
+                }
+
+                dfa_states[index] = dfa_state;
+            };
+
+            add_dfa_state(0);
+            dfa_states[0]->MarkAsInitial();
+            for (size_t i = 0; i < order.size(); i++) {
+                int index = order[i];
+                for (size_t letter = 0; letter < letters.size(); letter++) {
+                    int dst_index = table[index * letters.size() + letter];
+                    if (dst_index == -1) {
+                        continue;
+                    }
+
+                    if (dfa_states[dst_index] == nullptr) {
+                        add_dfa_state(dst_index);
+                        order.push_back(dst_index);
+                    }
+
+                    dfa_states[index]->AddTransition(letters[letter], dfa_states[dst_index]);
+                }
             }
         }
 
-        /// Used by DFA builder
-        std::string GenSetLabel(const std::set<AutomatonState*>& states) {
-            std::string label = "[";
-            for (AutomatonState* state: states) {
-                label.append(state->GetLabel());
-                label.append(", ");
+        /**
+         * Used by NFAToRegExp. Hash-consed regexp DAG, equal subexpressions are shared.
+         * Serialized like regexps were built from strings: union is "a+b", concatenation is raw,
+         * group braces its operand only if it has "+" or "*" inside, star is "(a)*"
+         */
+        class RegExpDag {
+        public:
+            using NodeId = uint32_t;
+
+            static constexpr NodeId EPSILON = 0;
+
+            RegExpDag() {
+                nodes_.push_back({ Kind::Epsilon, 0, 0, false, 1 });
             }
 
-            label.resize(label.size() - 2);
-            label.append("]");
-            return label;
+            /// Word of the source automaton, "1" is epsilon
+            NodeId Atom(const std::string& word) {
+                if (word.empty() || word == "1") {
+                    return EPSILON;
+                }
+
+                auto [iter, inserted] = atom_ids_.emplace(word, 0);
+                if (inserted) {
+                    iter->second = Intern({ Kind::Atom, static_cast<NodeId>(atoms_.size()), 0,
+                                            word.find_first_of("+*") != std::string::npos, word.size() });
+                    atoms_.push_back(word);
+                }
+
+                return iter->second;
+            }
+
+            NodeId Union(NodeId a, NodeId b) {
+                if (a == b) {
+                    return a;
+                }
+
+                return Intern({ Kind::Union, a, b, true, SizeSum(SizeSum(GetSize(a), GetSize(b)), 1) });
+            }
+
+            NodeId Concat(NodeId a, NodeId b) {
+                if (a == EPSILON) {
+                    return b;
+                }
+
+                if (b == EPSILON) {
+                    return a;
+                }
+
+                return Intern({ Kind::Concat, a, b, nodes_[a].has_plus_or_star || nodes_[b].has_plus_or_star,
+                                SizeSum(GetSize(a), GetSize(b)) });
+            }
+
+            /// Braces of a concatenation operand
+            NodeId Group(NodeId a) {
+                if (!nodes_[a].has_plus_or_star) {
+                    return a;
+                }
+
+                return Intern({ Kind::Group, a, 0, true, SizeSum(GetSize(a), 2) });
+            }
+
+            NodeId Star(NodeId a) {
+                if (a == EPSILON || nodes_[a].kind == Kind::Star) {
+                    return a;
+                }
+
+                return Intern({ Kind::Star, a, 0, true, SizeSum(GetSize(a), 3) });
+            }
+
+            size_t Size() const {
+                return nodes_.size();
+            }
+
+            /// Length of serialized node, saturates at UINT64_MAX
+            uint64_t GetSize(NodeId node_id) const {
+                return nodes_[node_id].size;
+            }
+
+            static uint64_t SizeSum(uint64_t lhs, uint64_t rhs) {
+                return lhs > UINT64_MAX - rhs ? UINT64_MAX : lhs + rhs;
+            }
+
+            void Serialize(NodeId node_id, std::string& out) const {
+                const Node& node = nodes_[node_id];
+                switch (node.kind) {
+                    case Kind::Epsilon:
+                        out.push_back('1');
+                        break;
+
+                    case Kind::Atom:
+                        out.append(atoms_[node.lhs]);
+                        break;
+
+                    case Kind::Union:
+                        Serialize(node.lhs, out);
+                        out.push_back('+');
+                        Serialize(node.rhs, out);
+                        break;
+
+                    case Kind::Concat:
+                        Serialize(node.lhs, out);
+                        Serialize(node.rhs, out);
+                        break;
+
+                    case Kind::Group:
+                        out.push_back('(');
+                        Serialize(node.lhs, out);
+                        out.push_back(')');
+                        break;
+
+                    case Kind::Star:
+                        out.push_back('(');
+                        Serialize(node.lhs, out);
+                        out.append(")*");
+                        break;
+                }
+            }
+
+            std::string Serialize(NodeId node_id) const {
+                std::string out;
+                Serialize(node_id, out);
+                return out;
+            }
+
+        private:
+            enum class Kind : uint8_t {
+                Epsilon,
+                Atom,
+                Union,
+                Concat,
+                Group,
+                Star
+            };
+
+            struct Node {
+                Kind kind;
+                /// Atom index for atoms
+                NodeId lhs;
+                NodeId rhs;
+                bool has_plus_or_star;
+                uint64_t size;
+            };
+
+            NodeId Intern(Node node) {
+                auto [iter, inserted] = node_ids_[static_cast<int>(node.kind)].emplace(
+                    static_cast<uint64_t>(node.lhs) << 32 | node.rhs, static_cast<NodeId>(nodes_.size()));
+                if (inserted) {
+                    nodes_.push_back(node);
+                }
+
+                return iter->second;
+            }
+
+        private:
+            std::vector<Node> nodes_;
+            /// Keyed by (lhs, rhs) for every kind
+            std::unordered_map<uint64_t, NodeId> node_ids_[6];
+
+            std::vector<std::string> atoms_;
+            std::unordered_map<std::string, NodeId> atom_ids_;
+        };
+
+        /// Used by product constructions
+        bool ApplyOperation(ProductOperation operation, bool in_lhs, bool in_rhs) {
+            switch (operation) {
+                case ProductOperation::Intersection:
+                    return in_lhs && in_rhs;
+                case ProductOperation::Union:
+                    return in_lhs || in_rhs;
+                case ProductOperation::Difference:
+                    return in_lhs && !in_rhs;
+                case ProductOperation::SymmetricDifference:
+                    return in_lhs != in_rhs;
+            }
+
+            return false;
         }
 
-        /// Used by NFAToRegExp
-        void RenameEpsTransitions(Automaton& automaton) {
-            for (AutomatonState* state : automaton.GetStates()) {
-                // Yes, we need a copy
-                auto transitions = state->GetTransitions();
-                for (auto& [word, dst_state] : transitions) {
-                    if (word.empty()) {
-                        state->RemoveTransition(word, dst_state);
-                        state->AddTransition("1", dst_state);
+        /// Used by product constructions. Missing state stands for the implicit sink of its automaton
+        struct StatePair {
+            AutomatonState* lhs;
+            AutomatonState* rhs;
+        };
+
+        /// Used by product constructions
+        bool IsFinalPair(const Automaton& lhs, const Automaton& rhs, StatePair pair, ProductOperation operation) {
+            bool in_lhs = pair.lhs != nullptr ? pair.lhs->IsFinal() : lhs.GetImplicitSink() == ImplicitSink::Accepting;
+            bool in_rhs = pair.rhs != nullptr ? pair.rhs->IsFinal() : rhs.GetImplicitSink() == ImplicitSink::Accepting;
+            return ApplyOperation(operation, in_lhs, in_rhs);
+        }
+
+        /**
+         * Used by product constructions. BFS over pairs reachable from the initial one,
+         * the pair of both sinks is never visited.
+         * on_pair(index, pair) is called on discovery, indices are given in discovery order. Returning false stops the walk.
+         * on_edge(src_index, symbol, dst_index) is called for every transition
+         */
+        template <typename OnPair, typename OnEdge>
+        void WalkProduct(const Automaton& lhs, const Automaton& rhs, OnPair on_pair, OnEdge on_edge) {
+            assert(lhs.IsDFA() && rhs.IsDFA());
+            assert(lhs.GetInitialState() != nullptr && rhs.GetInitialState() != nullptr);
+
+            // Keyed by (lhs id + 1, rhs id + 1), 0 is the sink
+            std::unordered_map<uint64_t, int> indices;
+            std::vector<StatePair> pairs;
+
+            auto discover = [&](StatePair pair) -> std::pair<int, bool> {
+                uint64_t key = static_cast<uint64_t>(pair.lhs != nullptr ? pair.lhs->GetNodeId() + 1 : 0) << 32 |
+                               (pair.rhs != nullptr ? pair.rhs->GetNodeId() + 1 : 0);
+                auto [iter, inserted] = indices.emplace(key, static_cast<int>(pairs.size()));
+                if (!inserted) {
+                    return { iter->second, true };
+                }
+
+                pairs.push_back(pair);
+                return { iter->second, on_pair(iter->second, pair) };
+            };
+
+            if (!discover({ lhs.GetInitialState(), rhs.GetInitialState() }).second) {
+                return;
+            }
+
+            static const TransitionList NO_EDGES;
+            for (size_t index = 0; index < pairs.size(); index++) {
+                StatePair pair = pairs[index];
+                const TransitionList& lhs_edges = pair.lhs != nullptr ? pair.lhs->GetEdges() : NO_EDGES;
+                const TransitionList& rhs_edges = pair.rhs != nullptr ? pair.rhs->GetEdges() : NO_EDGES;
+
+                // Merge by symbol, there is at most one transition by a symbol in a DFA
+                auto lhs_iter = lhs_edges.begin();
+                auto rhs_iter = rhs_edges.begin();
+                while (lhs_iter != lhs_edges.end() || rhs_iter != rhs_edges.end()) {
+                    SymbolId symbol = std::min(lhs_iter != lhs_edges.end() ? lhs_iter->symbol : NO_SYMBOL,
+                                               rhs_iter != rhs_edges.end() ? rhs_iter->symbol : NO_SYMBOL);
+
+                    StatePair dst_pair = { nullptr, nullptr };
+                    if (lhs_iter != lhs_edges.end() && lhs_iter->symbol == symbol) {
+                        dst_pair.lhs = lhs.GetState((lhs_iter++)->target);
+                    }
+
+                    if (rhs_iter != rhs_edges.end() && rhs_iter->symbol == symbol) {
+                        dst_pair.rhs = rhs.GetState((rhs_iter++)->target);
+                    }
+
+                    auto [dst_index, go_on] = discover(dst_pair);
+                    on_edge(static_cast<int>(index), symbol, dst_index);
+                    if (!go_on) {
+                        return;
                     }
                 }
             }
         }
 
-        /// Used by NFAToRegExp
-        void CollapseMultipleEdges(Automaton& automaton) {
+        /// Used by AreEquivalent. Union by size with path halving
+        class DisjointSets {
+        public:
+            explicit DisjointSets(size_t size) : parents_(size), sizes_(size, 1) {
+                for (size_t i = 0; i < size; i++) {
+                    parents_[i] = i;
+                }
+            }
+
+            size_t Find(size_t element) {
+                while (parents_[element] != element) {
+                    parents_[element] = parents_[parents_[element]];
+                    element = parents_[element];
+                }
+
+                return element;
+            }
+
+            /// @return False if elements were in the same set already
+            bool Unite(size_t lhs, size_t rhs) {
+                lhs = Find(lhs);
+                rhs = Find(rhs);
+                if (lhs == rhs) {
+                    return false;
+                }
+
+                if (sizes_[lhs] < sizes_[rhs]) {
+                    std::swap(lhs, rhs);
+                }
+
+                parents_[rhs] = lhs;
+                sizes_[lhs] += sizes_[rhs];
+                return true;
+            }
+
+        private:
+            std::vector<size_t> parents_;
+            std::vector<size_t> sizes_;
+        };
+
+        /// Used by language comparisons. Letters of both alphabets and of all transitions, sorted
+        std::vector<SymbolId> CollectLetters(const Automaton& lhs, const Automaton& rhs) {
+            std::vector<bool> present(EPS_SYMBOL, false);
+            for (const Automaton* automaton : { &lhs, &rhs }) {
+                for (char letter : automaton->GetAlphabet()) {
+                    present[LetterToSymbol(letter)] = true;
+                }
+
+                for (AutomatonState* state : automaton->GetStates()) {
+                    for (Transition transition : state->GetEdges()) {
+                        assert(transition.symbol < EPS_SYMBOL);
+                        present[transition.symbol] = true;
+                    }
+                }
+            }
+
+            std::vector<SymbolId> letters;
+            for (SymbolId symbol = 0; symbol < EPS_SYMBOL; symbol++) {
+                if (present[symbol]) {
+                    letters.push_back(symbol);
+                }
+            }
+
+            return letters;
+        }
+
+        /// Used by language comparisons. BFS node which remembers how it was reached
+        struct SearchStep {
+            int parent;
+            SymbolId letter;
+        };
+
+        /// Used by language comparisons
+        std::string RestoreWord(const std::vector<SearchStep>& steps, int step) {
+            std::string word;
+            for (; steps[step].parent != -1; step = steps[step].parent) {
+                word.push_back(static_cast<char>(steps[step].letter));
+            }
+
+            std::reverse(word.begin(), word.end());
+            return word;
+        }
+
+        /// Used by MinimizeCDFA. Iterative refinement by (class, classes of destinations) signatures
+        void MooreMinimize(Automaton &automaton) {
+            // Indexed by StateId
+            std::vector<int> classes(automaton.GetStateIdBound(), -1);
+
+            // Initial classes
             for (AutomatonState* state : automaton.GetStates()) {
-                std::unordered_map<AutomatonState*, std::vector<std::string>> transitions_by_state;
-                for (auto& [word, dst_state] : state->GetTransitions()) {
-                    transitions_by_state[dst_state].push_back(word);
+                classes[state->GetNodeId()] = static_cast<int>(state->IsFinal());
+            }
+
+            // Letters of the same byte class lead to the same states, one per class is enough
+            ByteClasses byte_classes(automaton);
+            std::vector<char> letters;
+            for (char letter : automaton.GetAlphabet()) {
+                if (byte_classes.IsRepresentative(letter)) {
+                    letters.push_back(letter);
                 }
+            }
 
-                for (auto& [dst_state, words] : transitions_by_state) {
-                    if (words.size() == 1) {
-                        continue;
+            std::map<std::pair<int, std::vector<int>>, std::set<AutomatonState*>> huge_classes;
+            while (true) {
+                huge_classes.clear();
+
+                for (AutomatonState* state : automaton.GetStates()) {
+                    std::vector<int> trans;
+                    for (char letter : letters) {
+                        AutomatonState* dst_state = state->FindTransition(LetterToSymbol(letter));
+                        assert(dst_state != nullptr);
+                        trans.push_back(classes[dst_state->GetNodeId()]);
                     }
 
-                    for (std::string& word : words) {
-                        state->RemoveTransition(word, dst_state);
+                    huge_classes[{classes[state->GetNodeId()], trans}].insert(state);
+                }
+
+                int slim_cls_cnt = 0;
+                std::vector<int> new_slim_classes(automaton.GetStateIdBound(), -1);
+                for (auto& [cls, states] : huge_classes) {
+                    for (AutomatonState* state2 : states) {
+                        new_slim_classes[state2->GetNodeId()] = slim_cls_cnt;
+                    }
+
+                    slim_cls_cnt++;
+                }
+
+                if (classes == new_slim_classes) {
+                    break;
+                } else {
+                    classes = new_slim_classes;
+                }
+            }
+
+            Automaton mcdfa(automaton.GetAlphabet());
+            std::vector<AutomatonState*> cls_nodes(huge_classes.size());
+            for (size_t i = 0; i < cls_nodes.size(); i++) {
+                cls_nodes[i] = mcdfa.InsertState();
+            }
+
+            for (auto& [cls, states] : huge_classes) {
+                for (AutomatonState* old_state : states) {
+                    if (old_state->IsFinal()) {
+                        cls_nodes[cls.first]->MarkAsFinal();
                     }
 
-                    std::string new_word = words[0];
-                    for (int i = 1; i < words.size(); i++) {
-                        new_word.append("+");
-                        new_word.append(words[i]);
+                    if (old_state->IsInitial()) {
+                        cls_nodes[cls.first]->MarkAsInitial();
                     }
+                }
 
-                    state->AddTransition(new_word, dst_state);
+                for (size_t i = 0; i < letters.size(); i++) {
+                    int dst_class = cls.second[i];
+                    for (char letter : byte_classes.GetLetters(byte_classes.GetClass(letters[i]))) {
+                        cls_nodes[cls.first]->AddTransition(LetterToSymbol(letter), cls_nodes[dst_class]);
+                    }
                 }
             }
+
+            automaton = std::move(mcdfa);
         }
 
-        /// Used by NFAToRegExp
-        std::string AutoBrace(const std::string& regexp) {
-            if (regexp.find('+') != -1 || regexp.find('*') != -1) {
-                return fmt::format("({})", regexp);
+        /**
+         * Refinable partition of [0; size) (Valmari & Lehtinen).
+         * Elements of every set occupy a contiguous range of elems_, marked ones are moved to the range beginning
+         */
+        class RefinablePartition {
+        public:
+            /**
+             * Groups elements by keys
+             * @param keys Key for each element, in [0; keys_count)
+             */
+            RefinablePartition(const std::vector<int>& keys, int keys_count) :
+                elems_(keys.size()), locations_(keys.size()), set_of_(keys.size()),
+                first_(std::max<size_t>(keys.size(), 1)), past_(first_.size()), marked_(first_.size(), 0),
+                sets_count_(0) {
+                // Counting sort by key
+                std::vector<int> key_offsets(keys_count + 1, 0);
+                for (int key : keys) {
+                    key_offsets[key + 1]++;
+                }
+
+                for (int key = 0; key < keys_count; key++) {
+                    key_offsets[key + 1] += key_offsets[key];
+                }
+
+                std::vector<int> key_sets(keys_count, -1);
+                for (int key = 0; key < keys_count; key++) {
+                    if (key_offsets[key] != key_offsets[key + 1]) {
+                        key_sets[key] = sets_count_;
+                        first_[sets_count_] = key_offsets[key];
+                        past_[sets_count_] = key_offsets[key + 1];
+                        sets_count_++;
+                    }
+                }
+
+                int elems_count = static_cast<int>(keys.size());
+                for (int elem = 0; elem < elems_count; elem++) {
+                    int location = key_offsets[keys[elem]]++;
+                    elems_[location] = elem;
+                    locations_[elem] = location;
+                    set_of_[elem] = key_sets[keys[elem]];
+                }
+            }
+
+            int GetSetsCount() const {
+                return sets_count_;
+            }
+
+            int GetSetOf(int elem) const {
+                return set_of_[elem];
+            }
+
+            /// Elements of the set s are elems[First(s)..Past(s))
+            int First(int set) const {
+                return first_[set];
+            }
+
+            int Past(int set) const {
+                return past_[set];
+            }
+
+            int Elem(int location) const {
+                return elems_[location];
+            }
+
+            void Mark(int elem) {
+                int set = set_of_[elem];
+                int location = locations_[elem];
+                int marked_past = first_[set] + marked_[set];
+                if (location < marked_past) {
+                    return;
+                }
+
+                elems_[location] = elems_[marked_past];
+                locations_[elems_[location]] = location;
+                elems_[marked_past] = elem;
+                locations_[elem] = marked_past;
+
+                if (marked_[set]++ == 0) {
+                    touched_.push_back(set);
+                }
+            }
+
+            /// Splits touched sets into marked and unmarked parts. The smaller part becomes a new set
+            void Split() {
+                while (!touched_.empty()) {
+                    int set = touched_.back();
+                    touched_.pop_back();
+
+                    int marked_past = first_[set] + marked_[set];
+                    marked_[set] = 0;
+                    if (marked_past == past_[set]) {
+                        continue;
+                    }
+
+                    int new_set = sets_count_++;
+                    if (marked_past - first_[set] <= past_[set] - marked_past) {
+                        first_[new_set] = first_[set];
+                        past_[new_set] = marked_past;
+                        first_[set] = marked_past;
+                    } else {
+                        past_[new_set] = past_[set];
+                        first_[new_set] = marked_past;
+                        past_[set] = marked_past;
+                    }
+
+                    for (int location = first_[new_set]; location < past_[new_set]; location++) {
+                        set_of_[elems_[location]] = new_set;
+                    }
+                }
+            }
+
+        private:
+            std::vector<int> elems_;
+            std::vector<int> locations_;
+            std::vector<int> set_of_;
+
+            std::vector<int> first_;
+            std::vector<int> past_;
+            std::vector<int> marked_;
+            std::vector<int> touched_;
+
+            int sets_count_;
+        };
+
+        /**
+         * Used by MinimizeCDFA and MinimizeDFA. Hopcroft-style refinement by Valmari & Lehtinen, O(m log n):
+         * blocks of states and "cords" of transitions with the same label refine each other.
+         * Missing transitions are fine as long as they lead to an (implicit) sink
+         * @param trim Drop states equivalent to the implicit sink. Result is partial then
+         */
+        void HopcroftMinimize(Automaton &automaton, bool trim) {
+            // Partition is the same for the complement, so the accepting sink is handled by flipping finality
+            bool flip = automaton.GetImplicitSink() == ImplicitSink::Accepting;
+
+            // Unreachable states don't affect the language
+            std::vector<AutomatonState*> states;
+            if (automaton.GetInitialState() != nullptr) {
+                std::vector<bool> visited(automaton.GetStateIdBound(), false);
+                AutomatonWalk(automaton, automaton.GetInitialState(), visited);
+                for (AutomatonState* state : automaton.GetStates()) {
+                    if (visited[state->GetNodeId()]) {
+                        states.push_back(state);
+                    }
+                }
             } else {
-                return regexp;
+                states = automaton.GetStates();
+            }
+
+            if (trim) {
+                // Keep only states which can reach acceptance, the rest are equivalent to the sink
+                std::vector<std::vector<AutomatonState*>> predecessors(automaton.GetStateIdBound());
+                std::vector<bool> alive(automaton.GetStateIdBound(), false);
+                std::vector<AutomatonState*> stack;
+                for (AutomatonState* state : states) {
+                    for (Transition transition : state->GetEdges()) {
+                        predecessors[transition.target].push_back(state);
+                    }
+
+                    if (state->IsFinal() != flip) {
+                        alive[state->GetNodeId()] = true;
+                        stack.push_back(state);
+                    }
+                }
+
+                while (!stack.empty()) {
+                    AutomatonState* state = stack.back();
+                    stack.pop_back();
+
+                    for (AutomatonState* predecessor : predecessors[state->GetNodeId()]) {
+                        if (!alive[predecessor->GetNodeId()]) {
+                            alive[predecessor->GetNodeId()] = true;
+                            stack.push_back(predecessor);
+                        }
+                    }
+                }
+
+                std::erase_if(states, [&alive](AutomatonState* state) { return !alive[state->GetNodeId()]; });
+            }
+
+            Automaton mcdfa(automaton.GetAlphabet());
+            mcdfa.SetImplicitSink(automaton.GetImplicitSink());
+
+            AutomatonState* initial = automaton.GetInitialState();
+            if (states.empty()) {
+                // Language is empty (or everything if the sink accepts)
+                if (initial != nullptr) {
+                    AutomatonState* lonely = mcdfa.InsertState();
+                    lonely->MarkAsInitial();
+                    if (flip) {
+                        lonely->MarkAsFinal();
+                    }
+                }
+
+                automaton = std::move(mcdfa);
+                return;
+            }
+
+            // Dense indices for remaining states, indexed by StateId
+            int states_count = static_cast<int>(states.size());
+            std::vector<int> indices(automaton.GetStateIdBound(), -1);
+            for (int i = 0; i < states_count; i++) {
+                indices[states[i]->GetNodeId()] = i;
+            }
+
+            // Letters of the same byte class lead to the same states, so only transitions by class representatives
+            // take part in refinement and labels are class ids
+            ByteClasses byte_classes(automaton);
+            std::vector<int> tails, heads, labels;
+            for (int i = 0; i < states_count; i++) {
+                for (Transition transition : states[i]->GetEdges()) {
+                    // Transitions to the trimmed states become missing ones
+                    if (indices[transition.target] == -1) {
+                        continue;
+                    }
+
+                    char letter = static_cast<char>(transition.symbol);
+                    if (!byte_classes.IsRepresentative(letter)) {
+                        continue;
+                    }
+
+                    tails.push_back(i);
+                    heads.push_back(indices[transition.target]);
+                    labels.push_back(byte_classes.GetClass(letter));
+                }
+            }
+
+            // Inverse transition lists
+            std::vector<int> in_offsets(states.size() + 1, 0);
+            for (int head : heads) {
+                in_offsets[head + 1]++;
+            }
+
+            for (int i = 0; i < states_count; i++) {
+                in_offsets[i + 1] += in_offsets[i];
+            }
+
+            std::vector<int> in_transitions(heads.size());
+            std::vector<int> in_fill(in_offsets.begin(), in_offsets.end() - 1);
+            for (size_t transition = 0; transition < heads.size(); transition++) {
+                in_transitions[in_fill[heads[transition]]++] = transition;
+            }
+
+            std::vector<int> finality(states.size());
+            for (int i = 0; i < states_count; i++) {
+                finality[i] = static_cast<int>(states[i]->IsFinal() != flip);
+            }
+
+            RefinablePartition blocks(finality, 2);
+            RefinablePartition cords(labels, byte_classes.GetClassesCount());
+
+            // Every block but the first one is a splitter. Split produces the smaller half as the new block
+            int block = 1;
+            int cord = 0;
+            while (cord < cords.GetSetsCount()) {
+                for (int i = cords.First(cord); i < cords.Past(cord); i++) {
+                    blocks.Mark(tails[cords.Elem(i)]);
+                }
+
+                blocks.Split();
+                cord++;
+
+                for (; block < blocks.GetSetsCount(); block++) {
+                    for (int i = blocks.First(block); i < blocks.Past(block); i++) {
+                        int state = blocks.Elem(i);
+                        for (int j = in_offsets[state]; j < in_offsets[state + 1]; j++) {
+                            cords.Mark(in_transitions[j]);
+                        }
+                    }
+
+                    cords.Split();
+                }
+            }
+
+            int blocks_count = blocks.GetSetsCount();
+            std::vector<AutomatonState*> block_nodes(blocks_count);
+            for (int i = 0; i < blocks_count; i++) {
+                block_nodes[i] = mcdfa.InsertState();
+            }
+
+            for (int i = 0; i < blocks_count; i++) {
+                AutomatonState* representative = states[blocks.Elem(blocks.First(i))];
+                if (representative->IsFinal()) {
+                    block_nodes[i]->MarkAsFinal();
+                }
+
+                for (Transition transition : representative->GetEdges()) {
+                    if (indices[transition.target] == -1) {
+                        continue;
+                    }
+
+                    int dst_block = blocks.GetSetOf(indices[transition.target]);
+                    block_nodes[i]->AddTransition(transition.symbol, block_nodes[dst_block]);
+                }
+            }
+
+            if (initial != nullptr) {
+                if (indices[initial->GetNodeId()] != -1) {
+                    block_nodes[blocks.GetSetOf(indices[initial->GetNodeId()])]->MarkAsInitial();
+                } else {
+                    // Initial state is equivalent to the sink
+                    AutomatonState* lonely = mcdfa.InsertState();
+                    lonely->MarkAsInitial();
+                    if (flip) {
+                        lonely->MarkAsFinal();
+                    }
+                }
             }
+
+            automaton = std::move(mcdfa);
         }
 
     } // namespace
@@ -158,7 +1266,7 @@ namespace formal {
         }
 
         for (AutomatonState* src_state : automaton.GetStates()) {
-            for (auto& [word, dst_state] : src_state->GetTransitions()) {
+            for (const auto& [word, dst_state] : src_state->GetTransitions()) {
                 dot_file << fmt::format("{} -> {} [label=\"{}\"]\n",
                                         PtrToIndex(src_state), PtrToIndex(dst_state),
                                         word.empty() ? "eps" : word);
@@ -172,9 +1280,101 @@ namespace formal {
     }
 
     void RemoveEpsTransitions(Automaton &automaton) {
-        StatewiseSet eps_closures;
+        // Every state of an eps-cycle has the same closure, so closures are built per component,
+        // successors first. Only final states and ones with letter transitions matter in a closure,
+        // they are kept as sorted indices into useful_states
+        int components_count = 0;
+        std::vector<int> components = FindEpsComponents(automaton, components_count);
+
+        std::vector<std::vector<AutomatonState*>> members(components_count);
+        std::vector<int> useful_indices(automaton.GetStateIdBound(), -1);
+        std::vector<AutomatonState*> useful_states;
+        // Original letter transitions, states get shortcuts while the others are still read
+        std::vector<TransitionList> letter_edges;
+        // Eps-transitions from other components yet to take the closure
+        std::vector<int> readers_left(components_count, 0);
+
+        for (AutomatonState* state : automaton.GetStates()) {
+            int component = components[state->GetNodeId()];
+            members[component].push_back(state);
+
+            auto [eps_begin, eps_end] = EpsEdges(state);
+            for (auto iter = eps_begin; iter != eps_end; ++iter) {
+                if (components[iter->target] != component) {
+                    readers_left[components[iter->target]]++;
+                }
+            }
+
+            TransitionList letters(state->GetEdges().begin(), eps_begin);
+            letters.insert(letters.end(), eps_end, state->GetEdges().end());
+            if (!letters.empty() || state->IsFinal()) {
+                useful_indices[state->GetNodeId()] = useful_states.size();
+                useful_states.push_back(state);
+                letter_edges.push_back(std::move(letters));
+            }
+        }
+
+        std::vector<std::vector<int>> closures(components_count);
+        std::vector<int> merged;
+        for (int component = 0; component < components_count; component++) {
+            std::vector<int> closure;
+            for (AutomatonState* state : members[component]) {
+                if (useful_indices[state->GetNodeId()] != -1) {
+                    closure.push_back(useful_indices[state->GetNodeId()]);
+                }
+            }
+
+            std::sort(closure.begin(), closure.end());
+            for (AutomatonState* state : members[component]) {
+                auto [eps_begin, eps_end] = EpsEdges(state);
+                for (auto iter = eps_begin; iter != eps_end; ++iter) {
+                    int dst_component = components[iter->target];
+                    if (dst_component == component) {
+                        continue;
+                    }
+
+                    merged.clear();
+                    std::set_union(closure.begin(), closure.end(), closures[dst_component].begin(),
+                                   closures[dst_component].end(), std::back_inserter(merged));
+                    closure.swap(merged);
+
+                    if (--readers_left[dst_component] == 0) {
+                        std::vector<int>().swap(closures[dst_component]);
+                    }
+                }
+            }
+
+            // Add shortcuts & mark states as final if necessary
+            for (AutomatonState* state : members[component]) {
+                for (int useful_index : closure) {
+                    if (useful_states[useful_index]->IsFinal()) {
+                        state->MarkAsFinal();
+                    }
+
+                    // Own transitions are already here
+                    if (useful_states[useful_index] == state) {
+                        continue;
+                    }
+
+                    for (Transition transition : letter_edges[useful_index]) {
+                        state->AddTransition(transition.symbol, automaton.GetState(transition.target));
+                    }
+                }
+            }
+
+            if (readers_left[component] > 0) {
+                closures[component] = std::move(closure);
+            }
+        }
+
+        // Remove eps transitions (they aren't need anymore)
         for (AutomatonState* state : automaton.GetStates()) {
-            EpsShortcutify(automaton, state, eps_closures);
+            auto [eps_begin, eps_end] = EpsEdges(state);
+            // Yes, we need a copy
+            TransitionList eps_edges(eps_begin, eps_end);
+            for (Transition transition : eps_edges) {
+                state->RemoveTransition(EPS_SYMBOL, automaton.GetState(transition.target));
+            }
         }
 
         Optimize(automaton);
@@ -183,113 +1383,94 @@ namespace formal {
     void Optimize(Automaton& automaton) {
         assert(automaton.GetInitialState() != nullptr);
 
-        StateSet visited;
+        std::vector<bool> visited(automaton.GetStateIdBound(), false);
         AutomatonWalk(automaton, automaton.GetInitialState(), visited);
 
         // Yes, we need a copy
         auto old_states = automaton.GetStates();
         for (AutomatonState* state : old_states) {
-            if (visited.find(state) == visited.end()) {
+            if (!visited[state->GetNodeId()]) {
                 state->Remove();
-            } else if (state->TransitionPresent("", state)) {
-                state->RemoveTransition("", state);
+            } else if (state->TransitionPresent(EPS_SYMBOL, state)) {
+                state->RemoveTransition(EPS_SYMBOL, state);
             }
         }
+
+        // Built by Remove, not needed anymore
+        automaton.ReleaseBackTransitions();
     }
 
-    void TransformToDFA(Automaton& automaton) {
+    void TransformToDFA(Automaton& automaton, int threads_count) {
         assert(automaton.GetInitialState() != nullptr && automaton.IsSingleLetter());
+        assert(automaton.GetImplicitSink() != ImplicitSink::Accepting);
+        assert(threads_count >= 1);
 
-        Automaton dfa(automaton.GetAlphabet());
-
-        AutomatonState* dfa_init_state = dfa.InsertState();
-        dfa_init_state->MarkAsInitial();
+        SubsetSuccessors successors(automaton);
 
-        // Mapping between states in the old NFA and their representations in DFA
-        // Can't use unordered_ versions here =(
-        std::map<std::set<AutomatonState*>, AutomatonState*> old2new;
-        std::unordered_map<AutomatonState*, std::set<AutomatonState*>> new2old;
-
-        AutomatonState* old_init_state = automaton.GetInitialState();
-        old2new[{ old_init_state }] = dfa_init_state;
-        new2old[dfa_init_state] = { old_init_state };
+        Automaton dfa(automaton.GetAlphabet());
+        dfa.SetImplicitSink(automaton.GetImplicitSink());
 
-        if (old_init_state->IsFinal()) {
-            dfa_init_state->MarkAsFinal();
+        if (threads_count > 1) {
+            BuildDFAParallel(automaton, successors, dfa, threads_count);
+        } else {
+            BuildDFASequential(automaton, successors, dfa);
         }
 
-        std::queue<AutomatonState*> queue;
-        queue.push(dfa_init_state);
-        while (!queue.empty()) {
-            AutomatonState* dfa_repr = queue.front();
-            queue.pop();
+        automaton = std::move(dfa);
+    }
 
-            auto& nfa_states = new2old[dfa_repr];
-            std::unordered_map<std::string, std::set<AutomatonState*>> nfa_states_dst;
-            for (AutomatonState* nfa_state : nfa_states) {
-                for (auto& [letter, nfa_state_dst] : nfa_state->GetTransitions()) {
-                    nfa_states_dst[letter].insert(nfa_state_dst);
-                }
-            }
+    void CompleteDFA(Automaton& automaton, bool virtual_sink) {
+        assert(automaton.IsDFA());
 
-            for (auto& [word, nfa_states_dst_letter] : nfa_states_dst) {
-                AutomatonState* dst_dfa_repr = nullptr;
-                if (old2new.find(nfa_states_dst_letter) == old2new.end()) {
-                    dst_dfa_repr = dfa.InsertState();
-                    dst_dfa_repr->SetLabel(GenSetLabel(nfa_states_dst_letter));
+        if (virtual_sink) {
+            if (automaton.GetImplicitSink() == ImplicitSink::None) {
+                automaton.SetImplicitSink(ImplicitSink::Rejecting);
+            }
 
-                    old2new[nfa_states_dst_letter] = dst_dfa_repr;
-                    new2old[dst_dfa_repr] = nfa_states_dst_letter;
+            return;
+        }
 
-                    for (AutomatonState* nfa_dst_state : nfa_states_dst_letter) {
-                        if (nfa_dst_state->IsFinal()) {
-                            dst_dfa_repr->MarkAsFinal();
-                            break;
-                        }
-                    }
+        AutomatonState* drain = automaton.InsertState();
+        drain->SetLabel("drain");
+        if (automaton.GetImplicitSink() == ImplicitSink::Accepting) {
+            drain->MarkAsFinal();
+        }
 
-                    queue.push(dst_dfa_repr);
-                } else {
-                    dst_dfa_repr = old2new[nfa_states_dst_letter];
-                }
+        automaton.SetImplicitSink(ImplicitSink::None);
 
-                dfa_repr->AddTransition(word, dst_dfa_repr);
+        // A letter is missing iff all letters of its byte class are, so only class representatives are looked up
+        ByteClasses byte_classes(automaton);
+        std::vector<LetterSet> class_letters;
+        for (char letter : automaton.GetAlphabet()) {
+            if (byte_classes.IsRepresentative(letter)) {
+                class_letters.push_back(byte_classes.GetLetters(byte_classes.GetClass(letter)));
             }
         }
 
-        automaton = std::move(dfa);
-    }
-
-    void CompleteDFA(Automaton& automaton) {
-        assert(automaton.IsDFA());
-
-        AutomatonState* drain = automaton.InsertState();
-        drain->SetLabel("drain");
-
+        bool drain_used = false;
         for (AutomatonState* state : automaton.GetStates()) {
             if (state == drain) {
                 continue;
             }
 
-            std::unordered_set<char> present_trans;
-            for (auto& [letter, dst_state] : state->GetTransitions()) {
-                present_trans.insert(letter[0]);
-            }
+            for (const LetterSet& letters : class_letters) {
+                if (state->FindTransition(LetterToSymbol(*letters.begin())) == nullptr) {
+                    for (char letter : letters) {
+                        state->AddTransition(LetterToSymbol(letter), drain);
+                    }
 
-            for (char letter : automaton.GetAlphabet()) {
-                if (present_trans.find(letter) == present_trans.end()) {
-                    state->AddTransition(std::string(1,letter), drain);
+                    drain_used = true;
                 }
             }
         }
 
-        if (drain->GetBackTransitions().empty()) {
+        if (!drain_used) {
             // Remove drain if already CDFA
             drain->Remove();
         } else {
             // Add drain loops otherwise
             for (char letter : automaton.GetAlphabet()) {
-                drain->AddTransition(std::string(1,letter), drain);
+                drain->AddTransition(LetterToSymbol(letter), drain);
             }
         }
     }
@@ -304,75 +1485,34 @@ namespace formal {
                 state->MarkAsFinal();
             }
         }
-    }
 
-    void MinimizeCDFA(Automaton &automaton) {
-        assert(IsCDFA(automaton));
-
-        std::unordered_map<AutomatonState*, int> classes;
-
-        // Initial classes
-        for (AutomatonState* state : automaton.GetStates()) {
-            classes[state] = static_cast<int>(state->IsFinal());
+        if (automaton.GetImplicitSink() == ImplicitSink::Rejecting) {
+            automaton.SetImplicitSink(ImplicitSink::Accepting);
+        } else if (automaton.GetImplicitSink() == ImplicitSink::Accepting) {
+            automaton.SetImplicitSink(ImplicitSink::Rejecting);
         }
+    }
 
-        std::map<std::pair<int, std::vector<int>>, std::set<AutomatonState*>> huge_classes;
-        while (true) {
-            huge_classes.clear();
-
-            for (AutomatonState* state : automaton.GetStates()) {
-                std::vector<int> trans;
-                for (char letter : automaton.GetAlphabet()) {
-                    auto iter = state->GetTransitions().find(std::string(1, letter));
-                    assert(iter != state->GetTransitions().end());
-                    trans.push_back(classes[iter->second]);
-                }
-
-                huge_classes[{classes[state], trans}].insert(state);
-            }
-
-            int slim_cls_cnt = 0;
-            std::unordered_map<AutomatonState*, int> new_slim_classes;
-            for (auto& [cls, states] : huge_classes) {
-                for (AutomatonState* state2 : states) {
-                    new_slim_classes[state2] = slim_cls_cnt;
-                }
-
-                slim_cls_cnt++;
-            }
+    void MinimizeCDFA(Automaton &automaton, MinimizationAlgorithm algorithm) {
+        assert(IsCDFA(automaton));
 
-            if (classes == new_slim_classes) {
+        switch (algorithm) {
+            case MinimizationAlgorithm::Moore:
+                // Moore wants real transitions everywhere
+                CompleteDFA(automaton);
+                MooreMinimize(automaton);
                 break;
-            } else {
-                classes = new_slim_classes;
-            }
-        }
 
-        Automaton mcdfa(automaton.GetAlphabet());
-        std::vector<AutomatonState*> cls_nodes(huge_classes.size());
-        for (int i = 0; i < cls_nodes.size(); i++) {
-            cls_nodes[i] = mcdfa.InsertState();
-        }
-
-        for (auto& [cls, states] : huge_classes) {
-            for (AutomatonState* old_state : states) {
-                if (old_state->IsFinal()) {
-                    cls_nodes[cls.first]->MarkAsFinal();
-                }
-
-                if (old_state->IsInitial()) {
-                    cls_nodes[cls.first]->MarkAsInitial();
-                }
-            }
-
-            auto alph_iter = automaton.GetAlphabet().begin();
-            for (int dst_class : cls.second) {
-                cls_nodes[cls.first]->AddTransition(std::string(1, *alph_iter), cls_nodes[dst_class]);
-                alph_iter++;
-            }
+            case MinimizationAlgorithm::Hopcroft:
+                // States equivalent to the virtual sink can be dropped
+                HopcroftMinimize(automaton, automaton.GetImplicitSink() != ImplicitSink::None);
+                break;
         }
+    }
 
-        automaton = std::move(mcdfa);
+    void MinimizeDFA(Automaton &automaton) {
+        assert(automaton.IsDFA());
+        HopcroftMinimize(automaton, true);
     }
 
     void SinglifyFinalState(Automaton &automaton, bool force) {
@@ -394,7 +1534,9 @@ namespace formal {
         assert(automaton.GetFinalStates().size() == 1);
     }
 
-    std::string NFAToRegExp(Automaton &automaton) {
+    std::string NFAToRegExp(Automaton &automaton, EliminationOrder order) {
+        assert(automaton.GetImplicitSink() != ImplicitSink::Accepting);
+
         int finals_count = automaton.GetFinalStates().size();
         if (finals_count == 0 || automaton.GetInitialState() == nullptr) {
             return "0";
@@ -409,68 +1551,234 @@ namespace formal {
 
         assert(automaton.GetFinalStates().size() == 1);
 
-        RenameEpsTransitions(automaton);
-        CollapseMultipleEdges(automaton);
+        using NodeId = RegExpDag::NodeId;
+        RegExpDag dag;
+
+        // Labels are ordered the way the automaton orders its words: letters by code,
+        // longer words by the time they were first used, every new expression gets the next order
+        std::vector<SymbolId> label_orders;
+        SymbolId next_order = EPS_SYMBOL + 1;
+        auto use_label = [&](NodeId label, SymbolId order) {
+            label_orders.resize(dag.Size(), NO_SYMBOL);
+            if (label_orders[label] == NO_SYMBOL) {
+                label_orders[label] = order != NO_SYMBOL ? order : next_order++;
+            }
+        };
+
+        // Single label per (src, dst) pair, edges are indexed by StateId in both directions
+        std::vector<std::map<StateId, NodeId>> out_labels(automaton.GetStateIdBound());
+        std::vector<std::map<StateId, NodeId>> in_labels(automaton.GetStateIdBound());
+
+        struct PendingLabel {
+            StateId src;
+            StateId dst;
+            NodeId label;
+        };
+
+        // Second labels of pairs, they are united in (src, dst) order
+        std::vector<PendingLabel> pending;
+        auto add_label = [&](StateId src, StateId dst, NodeId label) {
+            auto [iter, inserted] = out_labels[src].emplace(dst, label);
+            if (inserted) {
+                in_labels[dst][src] = label;
+            } else if (iter->second != label) {
+                pending.push_back({ src, dst, label });
+            }
+        };
 
-        while (true) {
-            AutomatonState* victim = nullptr;
-            for (AutomatonState* victim_candidate : automaton.GetStates()) {
-                if (!(victim_candidate->IsFinal() || victim_candidate->IsInitial())) {
-                    victim = victim_candidate;
-                    break;
+        auto collapse_pending = [&]() {
+            std::sort(pending.begin(), pending.end(), [](const PendingLabel& lhs, const PendingLabel& rhs) {
+                return std::tie(lhs.src, lhs.dst) < std::tie(rhs.src, rhs.dst);
+            });
+
+            for (size_t i = 0; i < pending.size();) {
+                StateId src = pending[i].src;
+                StateId dst = pending[i].dst;
+
+                std::vector<NodeId> labels = { out_labels[src][dst] };
+                for (; i < pending.size() && pending[i].src == src && pending[i].dst == dst; i++) {
+                    labels.push_back(pending[i].label);
+                }
+
+                std::sort(labels.begin(), labels.end(), [&](NodeId lhs, NodeId rhs) {
+                    return label_orders[lhs] < label_orders[rhs];
+                });
+                labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+
+                NodeId united = labels[0];
+                for (size_t j = 1; j < labels.size(); j++) {
+                    united = dag.Union(united, labels[j]);
+                }
+
+                use_label(united, NO_SYMBOL);
+                out_labels[src][dst] = united;
+                in_labels[dst][src] = united;
+            }
+
+            pending.clear();
+        };
+
+        // Move transitions to the DAG, states stay in the automaton to keep the elimination order
+        for (AutomatonState* state : automaton.GetStates()) {
+            for (const auto& [word, dst_state] : state->GetTransitions()) {
+                NodeId label = dag.Atom(word);
+                SymbolId symbol = automaton.FindWord(word);
+                use_label(label, symbol == EPS_SYMBOL ? LetterToSymbol('1') : symbol);
+                add_label(state->GetNodeId(), dst_state->GetNodeId(), label);
+            }
+        }
+
+        for (AutomatonState* state : automaton.GetStates()) {
+            // Yes, we need a copy
+            TransitionList transitions = state->GetEdges();
+            for (Transition transition : transitions) {
+                state->RemoveTransition(transition.symbol, automaton.GetState(transition.target));
+            }
+        }
+
+        collapse_pending();
+
+        using LabeledState = std::pair<NodeId, StateId>;
+        auto by_label_order = [&](const LabeledState& lhs, const LabeledState& rhs) {
+            return std::make_pair(label_orders[lhs.first], lhs.second) <
+                   std::make_pair(label_orders[rhs.first], rhs.second);
+        };
+
+        // Cost of eliminating state, smaller goes first
+        auto elimination_cost = [&](StateId id) -> uint64_t {
+            auto loop_iter = out_labels[id].find(id);
+            bool has_loop = loop_iter != out_labels[id].end();
+            uint64_t in_degree = in_labels[id].size() - has_loop;
+            uint64_t out_degree = out_labels[id].size() - has_loop;
+
+            if (order == EliminationOrder::MinDegree) {
+                return in_degree * out_degree;
+            }
+
+            // Every in-label is copied out_degree times instead of once and vice versa,
+            // the loop is copied into every shortcut
+            uint64_t in_size = 0;
+            for (auto [src_id, label] : in_labels[id]) {
+                in_size = src_id != id ? RegExpDag::SizeSum(in_size, dag.GetSize(label)) : in_size;
+            }
+
+            uint64_t out_size = 0;
+            for (auto [dst_id, label] : out_labels[id]) {
+                out_size = dst_id != id ? RegExpDag::SizeSum(out_size, dag.GetSize(label)) : out_size;
+            }
+
+            auto product = [](uint64_t lhs, uint64_t rhs) {
+                return lhs != 0 && rhs > UINT64_MAX / lhs ? UINT64_MAX : lhs * rhs;
+            };
+
+            uint64_t loop_size = has_loop ? RegExpDag::SizeSum(dag.GetSize(loop_iter->second), 3) : 0;
+            uint64_t cost = RegExpDag::SizeSum(product(in_size, out_degree), product(out_size, in_degree));
+            return RegExpDag::SizeSum(cost, product(loop_size, in_degree * out_degree));
+        };
+
+        // Lazily updated: entries of a state with outdated version are skipped
+        using QueueEntry = std::tuple<uint64_t, StateId, uint32_t>;
+        std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>> queue;
+        std::vector<uint32_t> versions(automaton.GetStateIdBound(), 0);
+        auto update_cost = [&](StateId id) {
+            AutomatonState* state = automaton.GetState(id);
+            if (state->IsInitial() || state->IsFinal()) {
+                return;
+            }
+
+            queue.emplace(elimination_cost(id), id, ++versions[id]);
+        };
+
+        if (order != EliminationOrder::Legacy) {
+            for (AutomatonState* state : automaton.GetStates()) {
+                update_cost(state->GetNodeId());
+            }
+        }
+
+        auto pick_victim = [&]() -> AutomatonState* {
+            if (order == EliminationOrder::Legacy) {
+                for (AutomatonState* victim_candidate : automaton.GetStates()) {
+                    if (!(victim_candidate->IsFinal() || victim_candidate->IsInitial())) {
+                        return victim_candidate;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            while (!queue.empty()) {
+                auto [cost, id, version] = queue.top();
+                queue.pop();
+                if (versions[id] == version && automaton.GetState(id) != nullptr) {
+                    return automaton.GetState(id);
                 }
             }
 
+            return nullptr;
+        };
+
+        while (true) {
+            AutomatonState* victim = pick_victim();
             if (victim == nullptr) {
                 break;
             }
 
-            const std::string* loop_re = nullptr;
-            for (auto& [dst_re, dst_state] : victim->GetTransitions()) {
-                if (dst_state == victim) {
-                    loop_re = &dst_re;
-                    break;
+            StateId victim_id = victim->GetNodeId();
+            auto loop_iter = out_labels[victim_id].find(victim_id);
+            NodeId loop_star = RegExpDag::EPSILON;
+            if (loop_iter != out_labels[victim_id].end()) {
+                loop_star = dag.Star(loop_iter->second);
+            }
+
+            std::vector<LabeledState> srcs;
+            for (auto [src_id, src_label] : in_labels[victim_id]) {
+                if (src_id != victim_id) {
+                    srcs.emplace_back(src_label, src_id);
+                    out_labels[src_id].erase(victim_id);
                 }
             }
 
-            for (auto& [src_re, src_state] : victim->GetBackTransitions()) {
-                if (src_state == victim) {
-                    continue;
+            std::vector<LabeledState> dsts;
+            for (auto [dst_id, dst_label] : out_labels[victim_id]) {
+                if (dst_id != victim_id) {
+                    dsts.emplace_back(dst_label, dst_id);
+                    in_labels[dst_id].erase(victim_id);
                 }
+            }
 
-                for (auto& [dst_re, dst_state] : victim->GetTransitions()) {
-                    if (dst_state == victim) {
-                        continue;
-                    }
+            std::sort(srcs.begin(), srcs.end(), by_label_order);
+            std::sort(dsts.begin(), dsts.end(), by_label_order);
 
-                    std::string shortcut_re;
-                    if (loop_re == nullptr && dst_re == "1") {
-                        shortcut_re = fmt::format("{}", src_re);
-                    }
-                    else if (loop_re == nullptr && src_re == "1") {
-                        shortcut_re = fmt::format("{}", dst_re);
-                    }
-                    else if (src_re == "1" && dst_re == "1" && loop_re != nullptr) {
-                        shortcut_re = fmt::format("({})*", *loop_re);
-                    }
-                    else if (loop_re == nullptr || *loop_re == "1") {
-                        shortcut_re = fmt::format("{}{}", AutoBrace(src_re), AutoBrace(dst_re));
-                    }
-                    else if (src_re == "1") {
-                        shortcut_re = fmt::format("({})*{}", *loop_re, AutoBrace(dst_re));
-                    }
-                    else if (dst_re == "1") {
-                        shortcut_re = fmt::format("{}({})*", AutoBrace(src_re), *loop_re);
+            for (auto [src_label, src_id] : srcs) {
+                for (auto [dst_label, dst_id] : dsts) {
+                    NodeId shortcut;
+                    if (loop_star == RegExpDag::EPSILON && dst_label == RegExpDag::EPSILON) {
+                        shortcut = src_label;
+                    } else if (loop_star == RegExpDag::EPSILON && src_label == RegExpDag::EPSILON) {
+                        shortcut = dst_label;
                     } else {
-                        shortcut_re = fmt::format("{}({})*{}", AutoBrace(src_re), *loop_re, AutoBrace(dst_re));
+                        shortcut = dag.Concat(dag.Group(src_label), dag.Concat(loop_star, dag.Group(dst_label)));
                     }
 
-                    src_state->AddTransition(shortcut_re, dst_state);
+                    use_label(shortcut, NO_SYMBOL);
+                    add_label(src_id, dst_id, shortcut);
                 }
             }
 
+            out_labels[victim_id].clear();
+            in_labels[victim_id].clear();
             victim->Remove();
-            CollapseMultipleEdges(automaton);
+            collapse_pending();
+
+            if (order != EliminationOrder::Legacy) {
+                for (auto [label, src_id] : srcs) {
+                    update_cost(src_id);
+                }
+
+                for (auto [label, dst_id] : dsts) {
+                    update_cost(dst_id);
+                }
+            }
         }
 
         assert(automaton.GetStates().size() == 2);
@@ -482,76 +1790,290 @@ namespace formal {
 
         // Determined regexp generation for the simple case
 
-        const std::string *iloop = nullptr, *floop = nullptr, *internode_fw = nullptr, *internode_bw = nullptr;
+        auto find_label = [&](AutomatonState* src, AutomatonState* dst) {
+            auto iter = out_labels[src->GetNodeId()].find(dst->GetNodeId());
+            return iter != out_labels[src->GetNodeId()].end() ? std::optional<NodeId>(iter->second) : std::nullopt;
+        };
 
-        for (auto& [word, dst_state] : initial->GetTransitions()) {
-            if (dst_state == initial) {
-                iloop = &word;
-            } else if (dst_state == final) {
-                internode_fw = &word;
+        std::optional<NodeId> iloop = find_label(initial, initial);
+        std::optional<NodeId> floop = find_label(final, final);
+        std::optional<NodeId> internode_fw = find_label(initial, final);
+        std::optional<NodeId> internode_bw = find_label(final, initial);
+
+        assert(internode_fw.has_value());
+
+        // Leave the remaining labels in the automaton
+        for (AutomatonState* state : { initial, final }) {
+            for (auto [dst_id, label] : out_labels[state->GetNodeId()]) {
+                state->AddTransition(dag.Serialize(label), automaton.GetState(dst_id));
             }
         }
 
-        for (auto& [word, dst_state] : final->GetTransitions()) {
-            if (dst_state == initial) {
-                internode_bw = &word;
-            } else if (dst_state == final) {
-                floop = &word;
+        // Stars of labels which are not there are skipped
+        auto star = [&](std::optional<NodeId> label) {
+            return label.has_value() ? dag.Star(*label) : RegExpDag::EPSILON;
+        };
+
+        // first half
+        NodeId regexp = dag.Concat(star(iloop), dag.Concat(dag.Group(*internode_fw), star(floop)));
+
+        if (internode_bw.has_value()) {
+            // second half - possible to return to initial if bw transition present
+            NodeId regexp2 = dag.Concat(dag.Group(*internode_bw), regexp);
+            regexp = dag.Concat(regexp, dag.Star(regexp2));
+        }
+
+        return dag.Serialize(regexp);
+    }
+
+    bool DFAReadWord(const Automaton &dfa, const std::string& word) {
+        assert(dfa.IsDFA());
+
+        AutomatonState* curr_state = dfa.GetInitialState();
+        for (char letter : word) {
+            curr_state = curr_state->FindTransition(LetterToSymbol(letter));
+            if (curr_state == nullptr) {
+                return dfa.GetImplicitSink() == ImplicitSink::Accepting;
             }
         }
 
-        assert(internode_fw != nullptr);
+        return curr_state->IsFinal();
+    }
 
-        std::string regexp;
+    bool NFAReadWord(const Automaton& automaton, const std::string& word) {
+        return NFAMatcher(automaton).Match(word);
+    }
 
-        // first half
+    Automaton BuildProduct(const Automaton& lhs, const Automaton& rhs, ProductOperation operation) {
+        LetterSet alphabet = lhs.GetAlphabet();
+        alphabet |= rhs.GetAlphabet();
 
-        if (iloop != nullptr) {
-            regexp.append(fmt::format("({})*", *iloop));
-        }
+        Automaton product(alphabet);
+        WalkProduct(lhs, rhs, [&](int, StatePair pair) {
+            AutomatonState* state = product.InsertState();
+            state->SetLabel(fmt::format("({}, {})", pair.lhs != nullptr ? pair.lhs->GetLabel() : "-",
+                                        pair.rhs != nullptr ? pair.rhs->GetLabel() : "-"));
+            if (IsFinalPair(lhs, rhs, pair, operation)) {
+                state->MarkAsFinal();
+            }
 
-        regexp.append(AutoBrace(*internode_fw));
+            return true;
+        }, [&](int src_index, SymbolId symbol, int dst_index) {
+            // Indices are StateIds as states are inserted in discovery order
+            product.GetState(src_index)->AddTransition(symbol, product.GetState(dst_index));
+        });
 
-        if (floop != nullptr) {
-            regexp.append(fmt::format("({})*", *floop));
+        product.GetState(0)->MarkAsInitial();
+
+        if (IsFinalPair(lhs, rhs, { nullptr, nullptr }, operation)) {
+            product.SetImplicitSink(ImplicitSink::Accepting);
+        } else if (lhs.GetImplicitSink() != ImplicitSink::None && rhs.GetImplicitSink() != ImplicitSink::None) {
+            product.SetImplicitSink(ImplicitSink::Rejecting);
         }
 
-        if (internode_bw != nullptr) {
-            // second half - possible to return to initial if bw transition present
-            std::string regexp2;
+        return product;
+    }
+
+    Automaton Intersect(const Automaton& lhs, const Automaton& rhs) {
+        return BuildProduct(lhs, rhs, ProductOperation::Intersection);
+    }
+
+    Automaton Union(const Automaton& lhs, const Automaton& rhs) {
+        return BuildProduct(lhs, rhs, ProductOperation::Union);
+    }
+
+    Automaton Difference(const Automaton& lhs, const Automaton& rhs) {
+        return BuildProduct(lhs, rhs, ProductOperation::Difference);
+    }
+
+    Automaton SymmetricDifference(const Automaton& lhs, const Automaton& rhs) {
+        return BuildProduct(lhs, rhs, ProductOperation::SymmetricDifference);
+    }
+
+    bool IsProductEmpty(const Automaton& lhs, const Automaton& rhs, ProductOperation operation) {
+        LetterSet alphabet = lhs.GetAlphabet();
+        alphabet |= rhs.GetAlphabet();
+        bool sink_final = IsFinalPair(lhs, rhs, { nullptr, nullptr }, operation);
+
+        // The final sink pair is reached by any letter of the alphabet which both states of a pair lack
+        auto has_edge = [](AutomatonState* state, char letter) {
+            return state != nullptr && state->FindTransition(LetterToSymbol(letter)) != nullptr;
+        };
+
+        bool empty = true;
+        WalkProduct(lhs, rhs, [&](int, StatePair pair) {
+            empty = !IsFinalPair(lhs, rhs, pair, operation);
+            if (empty && sink_final) {
+                empty = std::all_of(alphabet.begin(), alphabet.end(), [&](char letter) {
+                    return has_edge(pair.lhs, letter) || has_edge(pair.rhs, letter);
+                });
+            }
+
+            return empty;
+        }, [](int, SymbolId, int) {});
+
+        return empty;
+    }
+
+    bool AreEquivalent(const Automaton& lhs, const Automaton& rhs, std::string* counterexample) {
+        assert(lhs.IsDFA() && rhs.IsDFA());
+        assert(lhs.GetInitialState() != nullptr && rhs.GetInitialState() != nullptr);
+
+        // States of both automata in one space: lhs ids, lhs sink, rhs ids, rhs sink
+        size_t lhs_sink = lhs.GetStateIdBound();
+        size_t rhs_offset = lhs_sink + 1;
+        size_t rhs_sink = rhs_offset + rhs.GetStateIdBound();
+
+        auto is_final = [&](size_t element) {
+            if (element == lhs_sink) {
+                return lhs.GetImplicitSink() == ImplicitSink::Accepting;
+            }
+
+            if (element == rhs_sink) {
+                return rhs.GetImplicitSink() == ImplicitSink::Accepting;
+            }
 
-            regexp2.append(AutoBrace(*internode_bw));
+            return element < lhs_sink ? lhs.GetState(element)->IsFinal()
+                                      : rhs.GetState(element - rhs_offset)->IsFinal();
+        };
 
-            if (iloop != nullptr) {
-                regexp2.append(fmt::format("({})*", *iloop));
+        auto step = [&](size_t element, SymbolId letter) -> size_t {
+            if (element == lhs_sink || element == rhs_sink) {
+                return element;
             }
 
-            regexp2.append(AutoBrace(*internode_fw));
+            if (element < lhs_sink) {
+                AutomatonState* dst_state = lhs.GetState(element)->FindTransition(letter);
+                return dst_state != nullptr ? dst_state->GetNodeId() : lhs_sink;
+            }
+
+            AutomatonState* dst_state = rhs.GetState(element - rhs_offset)->FindTransition(letter);
+            return dst_state != nullptr ? rhs_offset + dst_state->GetNodeId() : rhs_sink;
+        };
+
+        std::vector<SymbolId> letters = CollectLetters(lhs, rhs);
+        DisjointSets sets(rhs_sink + 1);
+
+        // BFS finds a differing pair at the depth of the shortest counterexample: a pair skipped as united
+        // is linked by a chain of pairs which were reached not later than it
+        std::vector<std::pair<size_t, size_t>> pairs;
+        std::vector<SearchStep> steps;
+
+        auto visit = [&](size_t lhs_element, size_t rhs_element, int parent, SymbolId letter) {
+            if (!sets.Unite(lhs_element, rhs_element)) {
+                return true;
+            }
+
+            pairs.emplace_back(lhs_element, rhs_element);
+            steps.push_back({ parent, letter });
+            if (is_final(lhs_element) != is_final(rhs_element)) {
+                if (counterexample != nullptr) {
+                    *counterexample = RestoreWord(steps, static_cast<int>(steps.size()) - 1);
+                }
 
-            if (floop != nullptr) {
-                regexp2.append(fmt::format("({})*", *floop));
+                return false;
             }
 
-            regexp.append(fmt::format("({})*", regexp2));
+            return true;
+        };
+
+        if (!visit(lhs.GetInitialState()->GetNodeId(), rhs_offset + rhs.GetInitialState()->GetNodeId(), -1, NO_SYMBOL)) {
+            return false;
+        }
+
+        for (size_t index = 0; index < pairs.size(); index++) {
+            for (SymbolId letter : letters) {
+                auto [lhs_element, rhs_element] = pairs[index];
+                if (!visit(step(lhs_element, letter), step(rhs_element, letter), static_cast<int>(index), letter)) {
+                    return false;
+                }
+            }
         }
 
-        return regexp;
+        return true;
     }
 
-    bool DFAReadWord(const Automaton &dfa, const std::string& word) {
-        assert(dfa.IsDFA());
+    bool IsIncluded(const Automaton& lhs, const Automaton& rhs, std::string* counterexample) {
+        assert(lhs.HasNoEpsTransitions() && lhs.IsSingleLetter() && lhs.GetImplicitSink() != ImplicitSink::Accepting);
+        assert(rhs.HasNoEpsTransitions() && rhs.IsSingleLetter() && rhs.GetImplicitSink() != ImplicitSink::Accepting);
+
+        if (lhs.GetInitialState() == nullptr) {
+            return true;
+        }
+
+        DynamicBitset rhs_finals(rhs.GetStateIdBound());
+        for (AutomatonState* state : rhs.GetFinalStates()) {
+            rhs_finals.Set(state->GetNodeId());
+        }
+
+        // Explored pairs of (lhs state, subset of rhs states reached by the same word).
+        // Smaller subsets are easier to escape, so a pair is useless if its state has a subset of its subset explored
+        std::vector<std::pair<AutomatonState*, DynamicBitset>> pairs;
+        std::vector<SearchStep> steps;
+        // Antichains of subsets by lhs StateId
+        std::vector<std::vector<DynamicBitset>> antichains(lhs.GetStateIdBound());
+
+        auto visit = [&](AutomatonState* state, DynamicBitset subset, int parent, SymbolId letter) {
+            std::vector<DynamicBitset>& antichain = antichains[state->GetNodeId()];
+            for (const DynamicBitset& explored : antichain) {
+                if (explored.IsSubsetOf(subset)) {
+                    return true;
+                }
+            }
+
+            // Drop subsets which the new one covers
+            antichain.erase(std::remove_if(antichain.begin(), antichain.end(),
+                                           [&](const DynamicBitset& explored) { return subset.IsSubsetOf(explored); }),
+                            antichain.end());
+            antichain.push_back(subset);
+
+            steps.push_back({ parent, letter });
+            if (state->IsFinal() && !subset.Intersects(rhs_finals)) {
+                if (counterexample != nullptr) {
+                    *counterexample = RestoreWord(steps, static_cast<int>(steps.size()) - 1);
+                }
 
-        AutomatonState* curr_state = dfa.GetInitialState();
-        for (char letter : word) {
-            auto iter = curr_state->GetTransitions().equal_range(std::string(1, letter)).first;
-            if (iter->first != std::string(1, letter)) {
                 return false;
-            } else {
-                curr_state = iter->second;
+            }
+
+            pairs.emplace_back(state, std::move(subset));
+            return true;
+        };
+
+        DynamicBitset init_subset(rhs.GetStateIdBound());
+        if (rhs.GetInitialState() != nullptr) {
+            init_subset.Set(rhs.GetInitialState()->GetNodeId());
+        }
+
+        if (!visit(lhs.GetInitialState(), std::move(init_subset), -1, NO_SYMBOL)) {
+            return false;
+        }
+
+        for (size_t index = 0; index < pairs.size(); index++) {
+            // Edges are sorted by symbol, so every letter of the state is a contiguous run
+            const TransitionList& edges = pairs[index].first->GetEdges();
+            for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+                SymbolId letter = edges[begin].symbol;
+                for (end = begin; end < edges.size() && edges[end].symbol == letter; end++) {}
+
+                DynamicBitset dst_subset(rhs.GetStateIdBound());
+                pairs[index].second.ForEach([&](size_t rhs_id) {
+                    for (Transition transition : rhs.GetState(rhs_id)->GetEdges()) {
+                        if (transition.symbol == letter) {
+                            dst_subset.Set(transition.target);
+                        }
+                    }
+                });
+
+                for (size_t i = begin; i < end; i++) {
+                    if (!visit(lhs.GetState(edges[i].target), dst_subset, static_cast<int>(index), letter)) {
+                        return false;
+                    }
+                }
             }
         }
 
-        return curr_state->IsFinal();
+        return true;
     }
 
     bool IsCDFA(const Automaton& automaton) {
@@ -559,10 +2081,14 @@ namespace formal {
             return false;
         }
 
+        if (automaton.GetImplicitSink() != ImplicitSink::None) {
+            return true;
+        }
+
         for (AutomatonState* state : automaton.GetStates()) {
-            std::unordered_set<char> trans;
-            for (auto& [letter, dst_state] : state->GetTransitions()) {
-                trans.insert(letter[0]);
+            LetterSet trans;
+            for (Transition transition : state->GetEdges()) {
+                trans.Insert(static_cast<char>(transition.symbol));
             }
 
             if (trans != automaton.GetAlphabet()) {
@@ -0,0 +1,76 @@
+#include <unordered_map>
+#include <libformal/alphabet.hpp>
+#include <libformal/automaton_state.hpp>
+
+namespace formal {
+    ByteClasses::ByteClasses() : classes_count_(256) {
+        for (int byte = 0; byte < 256; byte++) {
+            classes_[byte] = byte;
+            representatives_[byte] = byte;
+        }
+    }
+
+    ByteClasses::ByteClasses(const Automaton& automaton) {
+        // Class ids grow with every split and are compacted in the end
+        std::array<int, 256> classes;
+        for (int byte = 0; byte < 256; byte++) {
+            classes[byte] = static_cast<int>(automaton.GetAlphabet().Contains(static_cast<char>(byte)));
+        }
+
+        int next_class = 2;
+
+        // (class, destination) -> class of the bytes which had that class and lead to that destination
+        std::unordered_map<uint64_t, int> splits;
+        for (AutomatonState* state : automaton.GetStates()) {
+            splits.clear();
+
+            // Destinations of a byte are adjacent and sorted, so bytes with the same destination sets
+            // go through the same chain of splits
+            for (Transition transition : state->GetEdges()) {
+                if (transition.symbol == EPS_SYMBOL) {
+                    continue;
+                }
+
+                if (transition.symbol > EPS_SYMBOL) {
+                    for (char letter : automaton.GetWord(transition.symbol)) {
+                        classes[static_cast<unsigned char>(letter)] = next_class++;
+                    }
+
+                    continue;
+                }
+
+                int& cls = classes[transition.symbol];
+                uint64_t key = (static_cast<uint64_t>(cls) << 32) | transition.target;
+                auto [iter, inserted] = splits.try_emplace(key, next_class);
+                if (inserted) {
+                    next_class++;
+                }
+
+                cls = iter->second;
+            }
+        }
+
+        std::unordered_map<int, int> dense_classes;
+        for (int byte = 0; byte < 256; byte++) {
+            auto [iter, inserted] = dense_classes.try_emplace(classes[byte], static_cast<int>(dense_classes.size()));
+            if (inserted) {
+                representatives_[iter->second] = byte;
+            }
+
+            classes_[byte] = iter->second;
+        }
+
+        classes_count_ = static_cast<int>(dense_classes.size());
+    }
+
+    LetterSet ByteClasses::GetLetters(int cls) const {
+        LetterSet letters;
+        for (int byte = 0; byte < 256; byte++) {
+            if (classes_[byte] == cls) {
+                letters.Insert(static_cast<char>(byte));
+            }
+        }
+
+        return letters;
+    }
+}
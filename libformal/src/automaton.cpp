@@ -1,16 +1,23 @@
 #include <libformal/automaton.hpp>
+#include <algorithm>
+#include <new>
 #include <libformal/automaton_state.hpp>
 
 namespace formal {
-    Automaton::Automaton(std::unordered_set<char> alphabet) :
-        alphabet_(std::move(alphabet)), respect_alphabet_(true), no_eps_(true), single_letter_(true),
-        initial_state_(nullptr), node_counter_(0) {}
+    Automaton::Automaton(LetterSet alphabet) :
+        alphabet_(std::move(alphabet)), respect_alphabet_(true), no_eps_(true), single_letter_(true), dfa_(true),
+        initial_state_(nullptr), implicit_sink_(ImplicitSink::None), back_transitions_built_(false) {}
 
     Automaton::Automaton(Automaton &&other) noexcept :
-      initial_state_(other.initial_state_), node_counter_(other.node_counter_),
-      states_(std::move(other.states_)), final_states_(std::move(other.final_states_)) {
+      alphabet_(std::move(other.alphabet_)), respect_alphabet_(other.respect_alphabet_), no_eps_(other.no_eps_),
+      single_letter_(other.single_letter_), dfa_(other.dfa_),
+      slabs_(std::move(other.slabs_)), states_by_id_(std::move(other.states_by_id_)),
+      states_(std::move(other.states_)), final_states_(std::move(other.final_states_)),
+      initial_state_(other.initial_state_), implicit_sink_(other.implicit_sink_), words_(std::move(other.words_)),
+      word_symbols_(std::move(other.word_symbols_)), back_transitions_(std::move(other.back_transitions_)),
+      back_transitions_built_(other.back_transitions_built_) {
         other.initial_state_ = nullptr;
-        other.node_counter_ = 0;
+        other.back_transitions_built_ = false;
 
         for (AutomatonState* state : states_) {
             state->ReassignOwner(this);
@@ -18,17 +25,27 @@ namespace formal {
     }
 
     Automaton& Automaton::operator=(Automaton &&other) noexcept {
-        for (AutomatonState* state : states_) {
-            delete state;
-        }
+        ReleaseArena();
+
+        alphabet_ = std::move(other.alphabet_);
+        respect_alphabet_ = other.respect_alphabet_;
+        no_eps_ = other.no_eps_;
+        single_letter_ = other.single_letter_;
+        dfa_ = other.dfa_;
 
         initial_state_ = other.initial_state_;
-        node_counter_ = other.node_counter_;
+        implicit_sink_ = other.implicit_sink_;
+        slabs_ = std::move(other.slabs_);
+        states_by_id_ = std::move(other.states_by_id_);
         states_ = std::move(other.states_);
         final_states_ = std::move(other.final_states_);
+        words_ = std::move(other.words_);
+        word_symbols_ = std::move(other.word_symbols_);
+        back_transitions_ = std::move(other.back_transitions_);
+        back_transitions_built_ = other.back_transitions_built_;
 
         other.initial_state_ = nullptr;
-        other.node_counter_ = 0;
+        other.back_transitions_built_ = false;
 
         for (AutomatonState* state : states_) {
             state->ReassignOwner(this);
@@ -38,49 +55,177 @@ namespace formal {
     }
 
     Automaton::~Automaton() {
-        for (AutomatonState* state : states_) {
-            delete state;
-        }
+        ReleaseArena();
     }
 
     AutomatonState *Automaton::InsertState()  {
-        AutomatonState* new_state = new AutomatonState(this);
-        states_.insert(new_state);
+        size_t slot = states_by_id_.size() % SLAB_SIZE;
+        if (slot == 0) {
+            slabs_.emplace_back(new std::byte[SLAB_SIZE * sizeof(AutomatonState)]);
+        }
+
+        auto* new_state = new (slabs_.back().get() + slot * sizeof(AutomatonState)) AutomatonState(this);
+        new_state->position_ = states_.size();
+        states_by_id_.push_back(new_state);
+        states_.push_back(new_state);
+
+        if (back_transitions_built_) {
+            back_transitions_.emplace_back();
+        }
+
         return new_state;
     }
 
-    void Automaton::OnNewTransition(AutomatonState* src, AutomatonState* dst, const std::string& word) {
+    bool Automaton::Belongs(AutomatonState* state) const {
+        return state != nullptr && state->GetNodeId() < states_by_id_.size() &&
+               states_by_id_[state->GetNodeId()] == state;
+    }
+
+    void Automaton::ReleaseState(AutomatonState* state) {
+        assert(Belongs(state));
+
+        // Swap with the last live state to keep states_ contiguous
+        AutomatonState* last_state = states_.back();
+        last_state->position_ = state->position_;
+        states_[state->position_] = last_state;
+        states_.pop_back();
+
+        states_by_id_[state->GetNodeId()] = nullptr;
+        if (back_transitions_built_) {
+            assert(back_transitions_[state->GetNodeId()].empty());
+            back_transitions_[state->GetNodeId()].shrink_to_fit();
+        }
+
+        state->~AutomatonState();
+    }
+
+    void Automaton::ReleaseArena() {
+        for (AutomatonState* state : states_) {
+            state->~AutomatonState();
+        }
+
+        states_.clear();
+        states_by_id_.clear();
+        final_states_.clear();
+        slabs_.clear();
+        initial_state_ = nullptr;
+        implicit_sink_ = ImplicitSink::None;
+
+        ReleaseBackTransitions();
+    }
+
+    SymbolId Automaton::InternWord(const std::string& word) {
+        if (word.size() <= 1) {
+            return word.empty() ? EPS_SYMBOL : LetterToSymbol(word[0]);
+        }
+
+        auto iter = word_symbols_.find(word);
+        if (iter != word_symbols_.end()) {
+            return iter->second;
+        }
+
+        auto symbol = static_cast<SymbolId>(EPS_SYMBOL + 1 + words_.size());
+        words_.push_back(word);
+        word_symbols_.emplace(words_.back(), symbol);
+        return symbol;
+    }
+
+    SymbolId Automaton::FindWord(const std::string& word) const {
+        if (word.size() <= 1) {
+            return word.empty() ? EPS_SYMBOL : LetterToSymbol(word[0]);
+        }
+
+        auto iter = word_symbols_.find(word);
+        return iter != word_symbols_.end() ? iter->second : NO_SYMBOL;
+    }
+
+    const std::string* Automaton::LetterWords() {
+        static const std::vector<std::string> words = []() {
+            std::vector<std::string> result;
+            for (SymbolId letter = 0; letter < EPS_SYMBOL; letter++) {
+                result.emplace_back(1, static_cast<char>(letter));
+            }
+
+            result.emplace_back();
+            return result;
+        }();
+
+        return words.data();
+    }
+
+    void Automaton::ReleaseBackTransitions() {
+        back_transitions_.clear();
+        back_transitions_.shrink_to_fit();
+        back_transitions_built_ = false;
+    }
+
+    void Automaton::BuildBackTransitions() const {
+        back_transitions_.assign(GetStateIdBound(), {});
+        for (AutomatonState* state : states_) {
+            for (Transition transition : state->GetEdges()) {
+                back_transitions_[transition.target].push_back({ transition.symbol, state->GetNodeId() });
+            }
+        }
+
+        for (TransitionList& back_transitions : back_transitions_) {
+            std::sort(back_transitions.begin(), back_transitions.end());
+        }
+
+        back_transitions_built_ = true;
+    }
+
+    void Automaton::OnNewTransition(AutomatonState* src, AutomatonState* dst, SymbolId symbol) {
+        if (back_transitions_built_) {
+            TransitionList& back_transitions = back_transitions_[dst->GetNodeId()];
+            Transition back_transition{ symbol, src->GetNodeId() };
+            back_transitions.insert(std::lower_bound(back_transitions.begin(), back_transitions.end(), back_transition),
+                                    back_transition);
+        }
+
         // Update our pessimistic data
 
-        if (word.empty()) {
+        if (symbol == EPS_SYMBOL) {
             no_eps_ = false;
             dfa_ = false;
         }
 
         if (respect_alphabet_) {
-            for (char letter : word) {
-                if (alphabet_.find(letter) == alphabet_.end()) {
+            for (char letter : GetWord(symbol)) {
+                if (!alphabet_.Contains(letter)) {
                     respect_alphabet_ = false;
                     break;
                 }
             }
         }
 
-        if (word.length() != 1) {
+        if (symbol >= EPS_SYMBOL) {
             single_letter_ = false;
             dfa_ = false;
         }
 
         if (single_letter_ && dfa_) {
-            for (auto& [letter, dst_state] : src->GetTransitions()) {
-                if (letter == word && dst_state != dst) {
-                    dfa_ = false;
-                    break;
-                }
+            // Transitions are sorted, so the ones with the same letter are adjacent
+            const TransitionList& transitions = src->GetEdges();
+            auto iter = std::lower_bound(transitions.begin(), transitions.end(), Transition{ symbol, 0 });
+            if (iter != transitions.end() && iter->symbol == symbol && std::next(iter) != transitions.end() &&
+                std::next(iter)->symbol == symbol) {
+                dfa_ = false;
             }
         }
     }
 
+    void Automaton::OnRemovedTransition(AutomatonState* src, AutomatonState* dst, SymbolId symbol) {
+        if (!back_transitions_built_) {
+            return;
+        }
+
+        TransitionList& back_transitions = back_transitions_[dst->GetNodeId()];
+        auto iter = std::lower_bound(back_transitions.begin(), back_transitions.end(),
+                                     Transition{ symbol, src->GetNodeId() });
+        assert(iter != back_transitions.end() && iter->target == src->GetNodeId());
+        back_transitions.erase(iter);
+    }
+
     void Automaton::ActualizeProperties() const {
         respect_alphabet_ = true;
         no_eps_ = true;
@@ -88,33 +233,31 @@ namespace formal {
         dfa_ = true;
 
         for (AutomatonState* state : GetStates()) {
-            std::unordered_set<char> present_trans;
-            for (auto& [word, dst_state] : state->GetTransitions()) {
-                if (word.empty()) {
+            const TransitionList& transitions = state->GetEdges();
+            for (size_t i = 0; i < transitions.size(); i++) {
+                SymbolId symbol = transitions[i].symbol;
+                if (symbol == EPS_SYMBOL) {
                     no_eps_ = false;
                     dfa_ = false;
                 }
 
-                if (word.size() != 1) {
+                if (symbol >= EPS_SYMBOL) {
                     single_letter_ = false;
                     dfa_ = false;
                 }
 
-                for (char letter : word) {
-                    if (alphabet_.find(letter) == alphabet_.end()) {
+                for (char letter : GetWord(symbol)) {
+                    if (!alphabet_.Contains(letter)) {
                         respect_alphabet_ = false;
                         break;
                     }
                 }
 
-                if (single_letter_ && dfa_) {
-                    if (present_trans.find(word[0]) != present_trans.end()) {
-                        dfa_ = false;
-                    } else {
-                        present_trans.insert(word[0]);
-                    }
+                // Transitions are sorted, so the ones with the same letter are adjacent
+                if (i > 0 && transitions[i - 1].symbol == symbol) {
+                    dfa_ = false;
                 }
             }
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <fmt/core.h>
+#include <libformal/automaton_state.hpp>
+#include <libformal/compiled_dfa.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FORMAL_SHUFFLE_X86
+#endif
+
+namespace formal {
+    namespace {
+        using ShuffleVector = std::array<uint8_t, CompiledDFA::SHUFFLE_MAX_STATES>;
+
+        /// Shuffle vector entry of a letter which leads every state to the dead one
+        constexpr uint8_t SHUFFLE_DEAD = 0x80;
+
+        /// Used by CompiledDFA constructor
+        bool ShuffleSupported() {
+#ifdef FORMAL_SHUFFLE_X86
+            return __builtin_cpu_supports("ssse3");
+#else
+            return false;
+#endif
+        }
+
+        /**
+         * Used by RunShuffle and RunFromAllStates.
+         * Replaces every state in states by the one reached after reading the chunk.
+         * Lanes which went through a SHUFFLE_DEAD entry come out with that bit set
+         */
+#ifdef FORMAL_SHUFFLE_X86
+        __attribute__((target("ssse3")))
+        void ShuffleStates(const ShuffleVector* shuffles, std::string_view chunk, ShuffleVector& states) {
+            __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(states.data()));
+
+            // Kept apart from the chain of shuffles, so it costs no latency
+            __m128i seen = _mm_setzero_si128();
+            for (char letter : chunk) {
+                auto shuffle = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(shuffles[static_cast<unsigned char>(letter)].data()));
+                current = _mm_shuffle_epi8(shuffle, current);
+                seen = _mm_or_si128(seen, shuffle);
+            }
+
+            current = _mm_or_si128(current, _mm_and_si128(seen, _mm_set1_epi8(static_cast<char>(SHUFFLE_DEAD))));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(states.data()), current);
+        }
+#else
+        void ShuffleStates(const ShuffleVector* shuffles, std::string_view chunk, ShuffleVector& states) {
+            ShuffleVector seen{};
+            for (char letter : chunk) {
+                const ShuffleVector& shuffle = shuffles[static_cast<unsigned char>(letter)];
+                for (int lane = 0; lane < CompiledDFA::SHUFFLE_MAX_STATES; lane++) {
+                    seen[lane] |= shuffle[lane];
+                    states[lane] = shuffle[states[lane] % CompiledDFA::SHUFFLE_MAX_STATES];
+                }
+            }
+
+            for (int lane = 0; lane < CompiledDFA::SHUFFLE_MAX_STATES; lane++) {
+                states[lane] |= seen[lane] & SHUFFLE_DEAD;
+            }
+        }
+#endif
+    }
+
+    CompiledDFA::CompiledDFA(const Automaton& dfa) : initial_row_(DEAD_ROW), use_shuffle_(false), shuffle_base_(0) {
+        assert(dfa.IsDFA());
+
+        ByteClasses byte_classes(dfa);
+        classes_ = byte_classes.GetMap();
+        row_size_ = byte_classes.GetClassesCount();
+
+        // Row 0 is reserved for the dead state
+        // Indexed by StateId
+        std::vector<int> indices(dfa.GetStateIdBound(), 0);
+        int states_count = 1;
+        for (AutomatonState* state : dfa.GetStates()) {
+            indices[state->GetNodeId()] = states_count++;
+        }
+
+        // Row offsets of all states must fit into RowOffset
+        size_t table_size = static_cast<size_t>(states_count) * row_size_;
+        if (table_size > static_cast<size_t>(std::numeric_limits<RowOffset>::max())) {
+            throw std::length_error(fmt::format("DFA of {} states and {} byte classes is too big to compile",
+                                                states_count - 1, row_size_));
+        }
+
+        table_.assign(table_size, DEAD_ROW);
+        final_.assign((states_count + 63) / 64, 0);
+        if (dfa.GetImplicitSink() == ImplicitSink::Accepting) {
+            final_[0] |= 1;
+        }
+
+        for (AutomatonState* state : dfa.GetStates()) {
+            int index = indices[state->GetNodeId()];
+            if (state->IsFinal()) {
+                final_[index / 64] |= uint64_t(1) << (index % 64);
+            }
+
+            for (Transition transition : state->GetEdges()) {
+                assert(transition.symbol < EPS_SYMBOL);
+                table_[index * row_size_ + classes_[transition.symbol]] = indices[transition.target] * row_size_;
+            }
+        }
+
+        if (dfa.GetInitialState() != nullptr) {
+            initial_row_ = indices[dfa.GetInitialState()->GetNodeId()] * row_size_;
+        }
+
+        if (ShuffleSupported()) {
+            // The dead state needs a lane only if some class leads there from some live states but not from all of them,
+            // so complete DFAs and letters outside the alphabet do not take one
+            bool dead_lane = states_count == 1;
+            for (int cls = 0; cls < row_size_ && !dead_lane; cls++) {
+                int dead_count = 0;
+                for (int state = 1; state < states_count; state++) {
+                    dead_count += table_[state * row_size_ + cls] == DEAD_ROW;
+                }
+
+                dead_lane = dead_count != 0 && dead_count != states_count - 1;
+            }
+
+            shuffle_base_ = dead_lane ? 0 : 1;
+            int lanes_count = states_count - shuffle_base_;
+            if (lanes_count <= SHUFFLE_MAX_STATES) {
+                use_shuffle_ = true;
+
+                // Vectors are per byte rather than per class to save a lookup on every step.
+                // Unused lanes stay in lane 0
+                shuffles_.assign(256, ShuffleVector{});
+                for (int byte = 0; byte < 256; byte++) {
+                    for (int lane = 0; lane < lanes_count; lane++) {
+                        int target = table_[(lane + shuffle_base_) * row_size_ + classes_[byte]] / row_size_;
+                        shuffles_[byte][lane] = target < shuffle_base_ ? SHUFFLE_DEAD : target - shuffle_base_;
+                    }
+                }
+            }
+        }
+    }
+
+    DynamicBitset CompiledDFA::MatchBatch(std::span<const std::string_view> words) const {
+        DynamicBitset accepted(words.size());
+        const RowOffset* table = table_.data();
+        const uint8_t* classes = classes_.data();
+
+        // Every lane walks its own word, a lane that reaches the end of its word takes the next one
+        // right away. Idle lanes have word index equal to words.size()
+        const unsigned char* data[BATCH_LANES];
+        const unsigned char* end[BATCH_LANES];
+        size_t word_index[BATCH_LANES];
+        RowOffset rows[BATCH_LANES];
+
+        size_t next_word = 0;
+        int active = 0;
+
+        // Loads the next nonempty word into the lane. Empty words are resolved on the spot
+        auto load_word = [&](int lane) {
+            while (next_word < words.size()) {
+                size_t index = next_word++;
+                if (words[index].empty()) {
+                    if (IsFinalRow(initial_row_)) {
+                        accepted.Set(index);
+                    }
+
+                    continue;
+                }
+
+                data[lane] = reinterpret_cast<const unsigned char*>(words[index].data());
+                end[lane] = data[lane] + words[index].size();
+                word_index[lane] = index;
+                rows[lane] = initial_row_;
+                return;
+            }
+
+            word_index[lane] = words.size();
+            active--;
+        };
+
+        for (int lane = 0; lane < BATCH_LANES; lane++) {
+            active++;
+            load_word(lane);
+        }
+
+        while (active > 0) {
+            for (int lane = 0; lane < BATCH_LANES; lane++) {
+                if (word_index[lane] == words.size()) [[unlikely]] {
+                    continue;
+                }
+
+                rows[lane] = table[rows[lane] + classes[*data[lane]++]];
+                if (data[lane] == end[lane]) [[unlikely]] {
+                    if (IsFinalRow(rows[lane])) {
+                        accepted.Set(word_index[lane]);
+                    }
+
+                    load_word(lane);
+                }
+            }
+        }
+
+        return accepted;
+    }
+
+    bool CompiledDFA::ParallelMatch(std::string_view word, int threads_count) const {
+        size_t chunks_count = std::min<size_t>(std::max(threads_count, 1), word.size() / MIN_PARALLEL_CHUNK);
+        if (chunks_count <= 1) {
+            return Match(word);
+        }
+
+        size_t chunk_size = (word.size() + chunks_count - 1) / chunks_count;
+        auto get_chunk = [&](size_t chunk) {
+            return word.substr(chunk * chunk_size, chunk_size);
+        };
+
+        // Indexed by chunk, the first chunk is run only from the initial state by the calling thread
+        std::vector<std::vector<RowOffset>> mappings(chunks_count);
+        std::vector<std::thread> threads;
+        for (size_t chunk = 1; chunk < chunks_count; chunk++) {
+            threads.emplace_back([&, chunk]() {
+                mappings[chunk] = RunFromAllStates(get_chunk(chunk));
+            });
+        }
+
+        RowOffset row = initial_row_;
+        if (use_shuffle_) {
+            row = RunShuffle(row, get_chunk(0));
+        } else {
+            const RowOffset* table = table_.data();
+            for (char letter : get_chunk(0)) {
+                row = table[row + classes_[static_cast<unsigned char>(letter)]];
+            }
+        }
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        for (size_t chunk = 1; chunk < chunks_count; chunk++) {
+            row = mappings[chunk][row / row_size_];
+        }
+
+        return IsFinalRow(row);
+    }
+
+    std::vector<CompiledDFA::RowOffset> CompiledDFA::RunFromAllStates(std::string_view chunk) const {
+        // Runs which reach the same row are merged after every block of letters
+        constexpr size_t MERGE_BLOCK = 256;
+
+        int states_count = GetStatesCount();
+        if (use_shuffle_) {
+            // All states fit into one vector, so every run goes in a single pass
+            ShuffleVector states{};
+            for (int lane = 0; lane + shuffle_base_ < states_count; lane++) {
+                states[lane] = lane;
+            }
+
+            ShuffleStates(shuffles_.data(), chunk, states);
+
+            // The dead state without a lane stays dead
+            std::vector<RowOffset> mapping(states_count, DEAD_ROW);
+            for (int lane = 0; lane + shuffle_base_ < states_count; lane++) {
+                mapping[lane + shuffle_base_] = LaneToRow(states[lane]);
+            }
+
+            return mapping;
+        }
+
+        const RowOffset* table = table_.data();
+
+        // Distinct rows reached so far, and the index of the run each state has turned into
+        std::vector<RowOffset> rows(states_count);
+        std::vector<int> run_of_state(states_count);
+        for (int state = 0; state < states_count; state++) {
+            rows[state] = state * row_size_;
+            run_of_state[state] = state;
+        }
+
+        // Indexed by state, -1 for rows not taken by any run yet
+        std::vector<int> run_of_row(states_count, -1);
+        std::vector<int> merged_run(states_count);
+
+        for (size_t begin = 0; begin < chunk.size(); begin += MERGE_BLOCK) {
+            size_t end = std::min(chunk.size(), begin + MERGE_BLOCK);
+
+            // Runs are independent, so stepping all of them on the same letter lets the loads overlap
+            for (size_t pos = begin; pos < end; pos++) {
+                int cls = classes_[static_cast<unsigned char>(chunk[pos])];
+                for (RowOffset& row : rows) {
+                    row = table[row + cls];
+                }
+            }
+
+            if (rows.size() == 1) {
+                continue;
+            }
+
+            size_t runs_count = 0;
+            for (size_t run = 0; run < rows.size(); run++) {
+                int& taken = run_of_row[rows[run] / row_size_];
+                if (taken == -1) {
+                    taken = static_cast<int>(runs_count);
+                    rows[runs_count++] = rows[run];
+                }
+
+                merged_run[run] = taken;
+            }
+
+            for (size_t run = 0; run < runs_count; run++) {
+                run_of_row[rows[run] / row_size_] = -1;
+            }
+
+            if (runs_count < rows.size()) {
+                for (int& run : run_of_state) {
+                    run = merged_run[run];
+                }
+
+                rows.resize(runs_count);
+            }
+        }
+
+        std::vector<RowOffset> mapping(states_count);
+        for (int state = 0; state < states_count; state++) {
+            mapping[state] = rows[run_of_state[state]];
+        }
+
+        return mapping;
+    }
+
+    CompiledDFA::RowOffset CompiledDFA::RunShuffle(RowOffset row, std::string_view chunk) const {
+        int state = row / row_size_;
+        if (state < shuffle_base_) {
+            return DEAD_ROW;
+        }
+
+        ShuffleVector states;
+        states.fill(state - shuffle_base_);
+        ShuffleStates(shuffles_.data(), chunk, states);
+        return LaneToRow(states[0]);
+    }
+
+    CompiledDFA::RowOffset CompiledDFA::LaneToRow(uint8_t lane) const {
+        return (lane & SHUFFLE_DEAD) != 0 ? DEAD_ROW : (lane + shuffle_base_) * row_size_;
+    }
+}
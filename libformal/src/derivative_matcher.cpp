@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <libformal/derivative_matcher.hpp>
+
+namespace formal {
+    DerivativeMatcher::DerivativeMatcher(const std::string& regexp) {
+        RegExpTermWalker walker(pool_);
+        TermId root = EvaluateRegExp(RegExpAst(regexp), walker);
+
+        AddState({});
+        std::fill(table_.begin(), table_.end(), DEAD_STATE);
+
+        initial_state_ = AddState({ root });
+    }
+
+    DerivativeMatcher::StateIndex DerivativeMatcher::Step(StateIndex state, char letter) {
+        TermSet derivatives;
+        for (TermId term : states_[state]) {
+            Derive(term, letter, derivatives);
+        }
+
+        std::sort(derivatives.begin(), derivatives.end());
+        derivatives.erase(std::unique(derivatives.begin(), derivatives.end()), derivatives.end());
+
+        StateIndex next = AddState(std::move(derivatives));
+        table_[state * ROW_SIZE + static_cast<unsigned char>(letter)] = next;
+        return next;
+    }
+
+    void DerivativeMatcher::Derive(TermId term, char letter, TermSet& derivatives) {
+        // A copy, the pool grows during the derivation
+        RegExpTerm node = pool_.Get(term);
+        switch (node.kind) {
+            case TermKind::Empty:
+            case TermKind::Epsilon:
+                break;
+
+            case TermKind::Letter:
+                if (node.letter == letter) {
+                    derivatives.push_back(pool_.Epsilon());
+                }
+
+                break;
+
+            case TermKind::Union:
+                Derive(node.lhs, letter, derivatives);
+                Derive(node.rhs, letter, derivatives);
+                break;
+
+            case TermKind::Concat: {
+                size_t begin = derivatives.size();
+                Derive(node.lhs, letter, derivatives);
+                for (size_t i = begin; i < derivatives.size(); i++) {
+                    derivatives[i] = pool_.Concat(derivatives[i], node.rhs);
+                }
+
+                if (pool_.IsNullable(node.lhs)) {
+                    Derive(node.rhs, letter, derivatives);
+                }
+
+                break;
+            }
+
+            case TermKind::Star: {
+                size_t begin = derivatives.size();
+                Derive(node.lhs, letter, derivatives);
+                for (size_t i = begin; i < derivatives.size(); i++) {
+                    derivatives[i] = pool_.Concat(derivatives[i], term);
+                }
+
+                break;
+            }
+        }
+    }
+
+    DerivativeMatcher::StateIndex DerivativeMatcher::AddState(TermSet terms) {
+        auto iter = state_indices_.find(terms);
+        if (iter != state_indices_.end()) {
+            return iter->second;
+        }
+
+        StateIndex index = static_cast<StateIndex>(states_.size());
+        bool final = std::any_of(terms.begin(), terms.end(), [this](TermId term) { return pool_.IsNullable(term); });
+
+        state_indices_.emplace(terms, index);
+        states_.push_back(std::move(terms));
+        table_.resize(table_.size() + ROW_SIZE, UNKNOWN_STATE);
+        final_.push_back(final);
+        return index;
+    }
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <libformal/automaton_state.hpp>
+#include <libformal/lazy_dfa.hpp>
+
+namespace formal {
+    LazyDFA::LazyDFA(const Automaton& nfa, size_t memory_budget) :
+        words_(DynamicBitset::WordsCount(nfa.GetStateIdBound())), nfa_finals_(nfa.GetStateIdBound()),
+        dead_final_(nfa.GetImplicitSink() == ImplicitSink::Accepting), subsets_(words_), initial_state_(DEAD_STATE),
+        flushes_count_(0), next_subset_(words_) {
+        assert(nfa.GetInitialState() != nullptr && nfa.IsSingleLetter() && nfa.HasNoEpsTransitions());
+
+        // Compact copy of the transitions, removed states get empty ranges
+        edge_offsets_.assign(nfa.GetStateIdBound() + 1, 0);
+        for (AutomatonState* state : nfa.GetStates()) {
+            edge_offsets_[state->GetNodeId() + 1] = state->GetEdges().size();
+            if (state->IsFinal()) {
+                nfa_finals_.Set(state->GetNodeId());
+            }
+        }
+
+        for (size_t i = 1; i < edge_offsets_.size(); i++) {
+            edge_offsets_[i] += edge_offsets_[i - 1];
+        }
+
+        edges_.resize(edge_offsets_.back());
+        for (AutomatonState* state : nfa.GetStates()) {
+            std::copy(state->GetEdges().begin(), state->GetEdges().end(),
+                      edges_.begin() + edge_offsets_[state->GetNodeId()]);
+        }
+
+        nfa_initial_ = nfa.GetInitialState()->GetNodeId();
+
+        size_t state_size = ROW_SIZE * sizeof(StateIndex) + words_ * sizeof(Word) + sizeof(uint8_t);
+        // The dead, the initial and the one being built
+        max_states_ = std::max<size_t>(memory_budget / state_size, 3);
+
+        Reset();
+    }
+
+    LazyDFA::StateIndex LazyDFA::Step(StateIndex state, unsigned char letter) {
+        std::fill(next_subset_.begin(), next_subset_.end(), 0);
+
+        const Word* subset = subsets_.Get(state);
+        for (size_t i = 0; i < words_; i++) {
+            for (Word word = subset[i]; word != 0; word &= word - 1) {
+                StateId nfa_state = i * DynamicBitset::WORD_BITS + std::countr_zero(word);
+
+                auto begin = edges_.begin() + edge_offsets_[nfa_state];
+                auto end = edges_.begin() + edge_offsets_[nfa_state + 1];
+                for (auto iter = std::lower_bound(begin, end, Transition{ letter, 0 });
+                     iter != end && iter->symbol == letter; ++iter) {
+                    next_subset_[iter->target / DynamicBitset::WORD_BITS] |=
+                        Word(1) << (iter->target % DynamicBitset::WORD_BITS);
+                }
+            }
+        }
+
+        auto [next, inserted] = subsets_.Insert(next_subset_.data());
+        if (!inserted) {
+            table_[state * ROW_SIZE + letter] = next;
+            return next;
+        }
+
+        if (static_cast<size_t>(subsets_.Size()) > max_states_) {
+            // The source state is gone with the rest of the cache, the transition is left unknown
+            Reset();
+            flushes_count_++;
+            auto [fresh, fresh_inserted] = subsets_.Insert(next_subset_.data());
+            return fresh_inserted ? AddState(next_subset_.data()) : fresh;
+        }
+
+        table_[state * ROW_SIZE + letter] = AddState(next_subset_.data());
+        return next;
+    }
+
+    LazyDFA::StateIndex LazyDFA::AddState(const Word* subset) {
+        StateIndex index = static_cast<StateIndex>(final_.size());
+        table_.resize(table_.size() + ROW_SIZE, UNKNOWN_STATE);
+
+        bool final = false;
+        for (size_t i = 0; i < words_; i++) {
+            final |= (subset[i] & nfa_finals_.Data()[i]) != 0;
+        }
+
+        final_.push_back(final);
+        return index;
+    }
+
+    void LazyDFA::Reset() {
+        subsets_.Clear();
+        table_.clear();
+        final_.clear();
+
+        std::vector<Word> subset(words_, 0);
+        subsets_.Insert(subset.data());
+        AddState(subset.data());
+        std::fill(table_.begin(), table_.end(), DEAD_STATE);
+        final_[DEAD_STATE] = dead_final_;
+
+        subset[nfa_initial_ / DynamicBitset::WORD_BITS] |= Word(1) << (nfa_initial_ % DynamicBitset::WORD_BITS);
+        subsets_.Insert(subset.data());
+        initial_state_ = AddState(subset.data());
+    }
+}
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <libformal/automaton_state.hpp>
+#include <libformal/nfa_matcher.hpp>
+
+namespace formal {
+    NFAMatcher::NFAMatcher(const Automaton& nfa, size_t masks_budget) :
+        words_(DynamicBitset::WordsCount(nfa.GetStateIdBound())), initial_(nfa.GetStateIdBound()),
+        finals_(nfa.GetStateIdBound()), letter_indices_(EPS_SYMBOL, -1), letters_count_(0) {
+        assert(nfa.GetInitialState() != nullptr && nfa.IsSingleLetter() && nfa.HasNoEpsTransitions());
+        assert(nfa.GetImplicitSink() != ImplicitSink::Accepting);
+
+        StateId bound = nfa.GetStateIdBound();
+        initial_.Set(nfa.GetInitialState()->GetNodeId());
+
+        // Letter of transitions into each state, EPS_SYMBOL if there are none yet, NO_SYMBOL if they differ
+        std::vector<SymbolId> entry_letters(bound, EPS_SYMBOL);
+        for (AutomatonState* state : nfa.GetStates()) {
+            if (state->IsFinal()) {
+                finals_.Set(state->GetNodeId());
+            }
+
+            for (Transition transition : state->GetEdges()) {
+                assert(transition.symbol < EPS_SYMBOL);
+                if (letter_indices_[transition.symbol] == -1) {
+                    letter_indices_[transition.symbol] = letters_count_++;
+                }
+
+                SymbolId& entry_letter = entry_letters[transition.target];
+                entry_letter = entry_letter == EPS_SYMBOL || entry_letter == transition.symbol ? transition.symbol
+                                                                                               : NO_SYMBOL;
+            }
+        }
+
+        bool homogeneous = std::find(entry_letters.begin(), entry_letters.end(), NO_SYMBOL) == entry_letters.end();
+        size_t follow_size = (bound + EPS_SYMBOL) * words_;
+        size_t successors_size = bound * letters_count_ * words_;
+
+        if (homogeneous && follow_size * sizeof(Word) <= masks_budget) {
+            mode_ = StepMode::Follow;
+            follow_masks_.assign(bound * words_, 0);
+            letter_masks_.assign(EPS_SYMBOL * words_, 0);
+
+            for (StateId id = 0; id < bound; id++) {
+                if (entry_letters[id] < EPS_SYMBOL) {
+                    letter_masks_[entry_letters[id] * words_ + id / DynamicBitset::WORD_BITS] |=
+                        Word(1) << (id % DynamicBitset::WORD_BITS);
+                }
+            }
+
+            for (AutomatonState* state : nfa.GetStates()) {
+                for (Transition transition : state->GetEdges()) {
+                    follow_masks_[state->GetNodeId() * words_ + transition.target / DynamicBitset::WORD_BITS] |=
+                        Word(1) << (transition.target % DynamicBitset::WORD_BITS);
+                }
+            }
+        } else if (successors_size * sizeof(Word) <= masks_budget) {
+            mode_ = StepMode::Successors;
+            successor_masks_.assign(successors_size, 0);
+
+            for (AutomatonState* state : nfa.GetStates()) {
+                for (Transition transition : state->GetEdges()) {
+                    size_t mask_pos =
+                        (state->GetNodeId() * letters_count_ + letter_indices_[transition.symbol]) * words_;
+                    successor_masks_[mask_pos + transition.target / DynamicBitset::WORD_BITS] |=
+                        Word(1) << (transition.target % DynamicBitset::WORD_BITS);
+                }
+            }
+        } else {
+            mode_ = StepMode::Scatter;
+            edge_offsets_.assign(bound + 1, 0);
+            for (AutomatonState* state : nfa.GetStates()) {
+                edge_offsets_[state->GetNodeId() + 1] = state->GetEdges().size();
+            }
+
+            for (size_t i = 1; i < edge_offsets_.size(); i++) {
+                edge_offsets_[i] += edge_offsets_[i - 1];
+            }
+
+            edges_.resize(edge_offsets_.back());
+            for (AutomatonState* state : nfa.GetStates()) {
+                std::copy(state->GetEdges().begin(), state->GetEdges().end(),
+                          edges_.begin() + edge_offsets_[state->GetNodeId()]);
+            }
+        }
+    }
+
+    bool NFAMatcher::Match(std::string_view word) const {
+        std::vector<Word> curr(initial_.Data(), initial_.Data() + words_);
+        std::vector<Word> next(words_);
+
+        for (char letter : word) {
+            Step(curr.data(), static_cast<unsigned char>(letter), next.data());
+            if (std::all_of(next.begin(), next.end(), [](Word word) { return word == 0; })) {
+                return false;
+            }
+
+            curr.swap(next);
+        }
+
+        for (size_t i = 0; i < words_; i++) {
+            if ((curr[i] & finals_.Data()[i]) != 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void NFAMatcher::Step(const Word* src, unsigned char letter, Word* dst) const {
+        std::fill(dst, dst + words_, 0);
+        if (letter_indices_[letter] == -1) {
+            return;
+        }
+
+        for (size_t i = 0; i < words_; i++) {
+            for (Word word = src[i]; word != 0; word &= word - 1) {
+                StateId state = i * DynamicBitset::WORD_BITS + std::countr_zero(word);
+
+                if (mode_ == StepMode::Scatter) {
+                    auto begin = edges_.begin() + edge_offsets_[state];
+                    auto end = edges_.begin() + edge_offsets_[state + 1];
+                    for (auto iter = std::lower_bound(begin, end, Transition{ letter, 0 });
+                         iter != end && iter->symbol == letter; ++iter) {
+                        dst[iter->target / DynamicBitset::WORD_BITS] |=
+                            Word(1) << (iter->target % DynamicBitset::WORD_BITS);
+                    }
+
+                    continue;
+                }
+
+                const Word* mask = follow_masks_.data() + state * words_;
+                if (mode_ == StepMode::Successors) {
+                    mask = successor_masks_.data() + (state * letters_count_ + letter_indices_[letter]) * words_;
+                }
+
+                for (size_t j = 0; j < words_; j++) {
+                    dst[j] |= mask[j];
+                }
+            }
+        }
+
+        if (mode_ == StepMode::Follow) {
+            const Word* letter_mask = letter_masks_.data() + letter * words_;
+            for (size_t j = 0; j < words_; j++) {
+                dst[j] &= letter_mask[j];
+            }
+        }
+    }
+}
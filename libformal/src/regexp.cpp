@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <unordered_map>
+#include <libformal/regexp.hpp>
+
+namespace formal {
+    namespace {
+        /// Used by RegExpAst constructor
+        struct RegExpNodeHash {
+            size_t operator()(const RegExpNode& node) const {
+                uint64_t hash = static_cast<uint64_t>(node.kind) << 8 | static_cast<unsigned char>(node.letter);
+                hash = hash * 0x9e3779b97f4a7c15 + static_cast<uint32_t>(node.lhs);
+                hash = hash * 0x9e3779b97f4a7c15 + static_cast<uint32_t>(node.rhs);
+                return hash ^ (hash >> 32);
+            }
+        };
+    }
+
+    RegExpAst::RegExpAst(const std::string& regexp) : max_depth_(0) {
+        postfix_.reserve(regexp.size());
+
+        // Indices of nodes which are not operands of anything yet
+        std::vector<int> stack;
+        std::unordered_map<RegExpNode, int, RegExpNodeHash> node_indices;
+        for (size_t pos = 0; pos < regexp.size(); pos++) {
+            char c = regexp[pos];
+            RegExpNode node{ RegExpNodeKind::Letter, c, -1, -1 };
+
+            switch (c) {
+                case '1':
+                    node.kind = RegExpNodeKind::Epsilon;
+                    break;
+
+                case '+':
+                case '.':
+                    if (stack.size() < 2) {
+                        throw RegExpProcessError(fmt::format("not enough operands for operation {} at pos {}", c, pos + 1));
+                    }
+
+                    node.kind = c == '+' ? RegExpNodeKind::Union : RegExpNodeKind::Concat;
+                    node.rhs = stack.back();
+                    stack.pop_back();
+                    node.lhs = stack.back();
+                    stack.pop_back();
+                    break;
+
+                case '*':
+                    if (stack.empty()) {
+                        throw RegExpProcessError(fmt::format("not enough operands for operation {} at pos {}", c, pos + 1));
+                    }
+
+                    node.kind = RegExpNodeKind::Star;
+                    node.lhs = stack.back();
+                    stack.pop_back();
+                    break;
+
+                default:
+                    break;
+            }
+
+            if (node.kind != RegExpNodeKind::Letter) {
+                node.letter = 0;
+            }
+
+            // Operands are already deduplicated, so equal nodes mean equal subexpressions
+            auto [iter, inserted] = node_indices.try_emplace(node, static_cast<int>(nodes_.size()));
+            if (inserted) {
+                nodes_.push_back(node);
+            }
+
+            stack.push_back(iter->second);
+            postfix_.push_back(iter->second);
+            max_depth_ = std::max(max_depth_, static_cast<int>(stack.size()));
+        }
+
+        if (stack.size() > 1) {
+            throw RegExpProcessError("unused operands were left");
+        }
+
+        if (stack.empty()) {
+            throw RegExpProcessError("empty regular expression");
+        }
+    }
+}
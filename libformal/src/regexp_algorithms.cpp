@@ -1,9 +1,30 @@
+#include <libformal/automaton_state.hpp>
 #include <libformal/regexp_algorithms.hpp>
 
 namespace formal {
+    namespace {
+        /**
+         * Used by PrefixedMinWalker. dst[n] = min(dst[n], shift + src[n - shift]) for every n >= shift.
+         * Branchless, so the loop gets vectorized
+         */
+        void MinPlusShifted(std::vector<int>& dst, const std::vector<int>& src, int shift) {
+            int size = static_cast<int>(dst.size());
+            int* dst_data = dst.data();
+            const int* src_data = src.data();
+            for (int n = shift; n < size; n++) {
+                int len = src_data[n - shift] == INT_NONE ? INT_NONE : src_data[n - shift] + shift;
+                dst_data[n] = std::min(dst_data[n], len);
+            }
+        }
+    }
+
     int GetPrefixedMin(const std::string& regexp, char letter, int count) {
+        return GetPrefixedMin(RegExpAst(regexp), letter, count);
+    }
+
+    int GetPrefixedMin(const RegExpAst& regexp, char letter, int count) {
         formal::PrefixedMinWalker walker(letter, count);
-        formal::PrefixedMinResult result = formal::ProcessRPNRegExp(regexp, walker);
+        formal::PrefixedMinResult result = formal::EvaluateRegExp(regexp, walker);
         return result.min_prefixed_len[count];
     }
 
@@ -12,7 +33,7 @@ namespace formal {
         result.min_prefixed_len[0] = 1;
 
         if (letter == pref_letter_ && count_ > 0) {
-            result.has_prefix[1] = true;
+            result.has_prefix.Set(1);
             result.min_prefixed_len[1] = 1;
         }
 
@@ -22,13 +43,13 @@ namespace formal {
     PrefixedMinResult PrefixedMinWalker::ProcessEpsilon() {
         PrefixedMinResult result = InstantiateEmptyResult();
         result.min_prefixed_len[0] = 0;
-        result.has_prefix[0] = true;
+        result.has_prefix.Set(0);
         return result;
     }
 
     PrefixedMinResult PrefixedMinWalker::ProcessUnion(PrefixedMinResult a, PrefixedMinResult b) {
+        a.has_prefix |= b.has_prefix;
         for (int i = 0; i <= count_; i++) {
-            a.has_prefix[i] = a.has_prefix[i] || b.has_prefix[i];
             a.min_prefixed_len[i] = std::min(a.min_prefixed_len[i], b.min_prefixed_len[i]);
         }
 
@@ -37,43 +58,281 @@ namespace formal {
 
     PrefixedMinResult PrefixedMinWalker::ProcessConcat(PrefixedMinResult a, PrefixedMinResult b) {
         PrefixedMinResult result = InstantiateEmptyResult();
-        for (int x_count = 0; x_count <= count_; x_count++) {
-            // has x^k if left has x^n, right has x^m and n+m=k
-            for (int x_on_left = 0; x_on_left <= x_count; x_on_left++) {
-                if (a.has_prefix[x_on_left] && b.has_prefix[x_count - x_on_left]) {
-                    result.has_prefix[x_count] = true;
-                    break;
-                }
-            }
 
-            // try to split x^k.w between a.b
-            for (int x_on_left = 0; x_on_left <= x_count; x_on_left++) {
-                if (a.has_prefix[x_on_left] && b.min_prefixed_len[x_count - x_on_left] != INT_NONE) {
-                    int len = x_on_left + b.min_prefixed_len[x_count - x_on_left];
+        // x^n on the left, then either x^m or x^m.w on the right
+        a.has_prefix.ForEach([&](size_t x_on_left) {
+            result.has_prefix.OrShifted(b.has_prefix, x_on_left);
+            MinPlusShifted(result.min_prefixed_len, b.min_prefixed_len, static_cast<int>(x_on_left));
+        });
+
+        // uncovered case - x^k.w in a, but not x^k
+        if (b.min_prefixed_len[0] != INT_NONE) {
+            for (int x_count = 0; x_count <= count_; x_count++) {
+                if (a.min_prefixed_len[x_count] != INT_NONE) {
+                    int len = a.min_prefixed_len[x_count] + b.min_prefixed_len[0];
                     result.min_prefixed_len[x_count] = std::min(result.min_prefixed_len[x_count], len);
                 }
             }
+        }
+
+        return result;
+    }
+
+    PrefixedMinResult PrefixedMinWalker::ProcessStar(PrefixedMinResult a) {
+        // Shortest word with x^n prefix is some nonempty factors x^p covering x^s, s <= n,
+        // then at most one factor covering the rest x^(n-s) of the prefix. Further factors only make it longer
+        PrefixedMinResult result = InstantiateEmptyResult();
 
-            // uncovered case - x^k.w in a, but not x^k
-            if (a.min_prefixed_len[x_count] != INT_NONE && b.min_prefixed_len[0] != INT_NONE) {
-                int len = a.min_prefixed_len[x_count] + b.min_prefixed_len[0];
-                result.min_prefixed_len[x_count] = std::min(result.min_prefixed_len[x_count], len);
+        // x^n is a sequence of nonempty factors, every covered x^s may be followed by one more
+        DynamicBitset factors = a.has_prefix;
+        factors.Reset(0);
+        result.has_prefix.Set(0);
+        for (int covered = 0; covered <= count_; covered++) {
+            if (result.has_prefix.Test(covered)) {
+                result.has_prefix.OrShifted(factors, covered);
             }
         }
 
+        // Factor covering the rest may also be x^(n-s) itself or absent at all, both give length n
+        result.has_prefix.ForEach([&](size_t covered) {
+            result.min_prefixed_len[covered] = static_cast<int>(covered);
+            MinPlusShifted(result.min_prefixed_len, a.min_prefixed_len, static_cast<int>(covered));
+        });
+
         return result;
     }
 
-    PrefixedMinResult PrefixedMinWalker::ProcessStar(PrefixedMinResult a) {
-        // just do 1 + x^1 + ... + x^count
+    PrefixedMinTable::PrefixedMinTable(LetterSet letters, int count, int shortest, std::vector<int> table) :
+        letters_(letters), letter_indices_{}, count_(count), shortest_(shortest), table_(std::move(table)) {
+        int index = 0;
+        for (char letter : letters_) {
+            letter_indices_[static_cast<unsigned char>(letter)] = index++;
+        }
+    }
+
+    PrefixedMinTable GetPrefixedMinTable(const std::string& regexp, int count) {
+        return GetPrefixedMinTable(RegExpAst(regexp), count);
+    }
+
+    PrefixedMinTable GetPrefixedMinTable(const RegExpAst& regexp, int count) {
+        LetterSet letters;
+        for (const RegExpNode& node : regexp.GetNodes()) {
+            if (node.kind == RegExpNodeKind::Letter) {
+                letters.Insert(node.letter);
+            }
+        }
+
+        AllLettersPrefixedMinWalker walker(letters, count);
+        std::vector<PrefixedMinResult> results = EvaluateRegExp(regexp, walker);
+
+        std::vector<int> table;
+        table.reserve(letters.Size() * (count + 1));
+        for (const PrefixedMinResult& result : results) {
+            table.insert(table.end(), result.min_prefixed_len.begin(), result.min_prefixed_len.end());
+        }
+
+        // Shortest word doesn't depend on the letter. Without letters the only word is the empty one
+        int shortest = results.empty() ? 0 : results[0].min_prefixed_len[0];
+
+        return PrefixedMinTable(letters, count, shortest, std::move(table));
+    }
+
+    AllLettersPrefixedMinWalker::AllLettersPrefixedMinWalker(const LetterSet& letters, int count) {
+        for (char letter : letters) {
+            walkers_.emplace_back(letter, count);
+        }
+    }
+
+    AllLettersPrefixedMinWalker::Result AllLettersPrefixedMinWalker::ProcessSingleLetter(char letter) {
+        Result result;
+        result.reserve(walkers_.size());
+        for (PrefixedMinWalker& walker : walkers_) {
+            result.push_back(walker.ProcessSingleLetter(letter));
+        }
+
+        return result;
+    }
+
+    AllLettersPrefixedMinWalker::Result AllLettersPrefixedMinWalker::ProcessEpsilon() {
+        Result result;
+        result.reserve(walkers_.size());
+        for (PrefixedMinWalker& walker : walkers_) {
+            result.push_back(walker.ProcessEpsilon());
+        }
+
+        return result;
+    }
+
+    AllLettersPrefixedMinWalker::Result AllLettersPrefixedMinWalker::ProcessUnion(Result a, Result b) {
+        for (size_t i = 0; i < walkers_.size(); i++) {
+            a[i] = walkers_[i].ProcessUnion(std::move(a[i]), std::move(b[i]));
+        }
+
+        return a;
+    }
+
+    AllLettersPrefixedMinWalker::Result AllLettersPrefixedMinWalker::ProcessConcat(Result a, Result b) {
+        for (size_t i = 0; i < walkers_.size(); i++) {
+            a[i] = walkers_[i].ProcessConcat(std::move(a[i]), std::move(b[i]));
+        }
+
+        return a;
+    }
+
+    AllLettersPrefixedMinWalker::Result AllLettersPrefixedMinWalker::ProcessStar(Result a) {
+        for (size_t i = 0; i < walkers_.size(); i++) {
+            a[i] = walkers_[i].ProcessStar(std::move(a[i]));
+        }
+
+        return a;
+    }
+
+    Automaton RegExpToNFA(const std::string& regexp, NFAConstruction construction) {
+        return RegExpToNFA(RegExpAst(regexp), construction);
+    }
+
+    Automaton RegExpToNFA(const RegExpAst& regexp, NFAConstruction construction) {
+        LetterSet alphabet;
+        for (const RegExpNode& node : regexp.GetNodes()) {
+            if (node.kind == RegExpNodeKind::Letter) {
+                alphabet.Insert(node.letter);
+            }
+        }
+
+        Automaton automaton(alphabet);
+        RegExpToNFAWalker walker(automaton, construction);
+        walker.Finish(EvaluateRegExp(regexp, walker));
+        return automaton;
+    }
+
+    RegExpToNFAWalker::RegExpToNFAWalker(Automaton& automaton, NFAConstruction construction) :
+        automaton_(automaton), construction_(construction), initial_state_(nullptr) {
+        if (construction_ == NFAConstruction::Glushkov) {
+            initial_state_ = automaton_.InsertState();
+        }
+    }
 
-        PrefixedMinResult result = ProcessEpsilon();
-        PrefixedMinResult power = a;
-        for (int i = 0; i < count_; i++) {
-            result = ProcessUnion(result, power);
-            power = ProcessConcat(power, a);
+    NFAFragment RegExpToNFAWalker::ProcessSingleLetter(char letter) {
+        if (construction_ == NFAConstruction::Thompson) {
+            NFAFragment result = NewThompsonFragment();
+            automaton_.GetState(result.first[0])->AddTransition(LetterToSymbol(letter),
+                                                                automaton_.GetState(result.last[0]));
+            return result;
         }
 
+        AutomatonState* position = automaton_.InsertState();
+        position->SetLabel(std::string(1, letter));
+        position_letters_.resize(automaton_.GetStateIdBound(), NO_SYMBOL);
+        position_letters_[position->GetNodeId()] = LetterToSymbol(letter);
+
+        NFAFragment result;
+        result.first.push_back(position->GetNodeId());
+        result.last.push_back(position->GetNodeId());
+        return result;
+    }
+
+    NFAFragment RegExpToNFAWalker::ProcessEpsilon() {
+        if (construction_ == NFAConstruction::Thompson) {
+            NFAFragment result = NewThompsonFragment();
+            automaton_.GetState(result.first[0])->AddTransition(EPS_SYMBOL, automaton_.GetState(result.last[0]));
+            return result;
+        }
+
+        NFAFragment result;
+        result.nullable = true;
+        return result;
+    }
+
+    NFAFragment RegExpToNFAWalker::ProcessUnion(NFAFragment a, NFAFragment b) {
+        if (construction_ == NFAConstruction::Thompson) {
+            NFAFragment result = NewThompsonFragment();
+            AutomatonState* entry = automaton_.GetState(result.first[0]);
+            AutomatonState* exit = automaton_.GetState(result.last[0]);
+            entry->AddTransition(EPS_SYMBOL, automaton_.GetState(a.first[0]));
+            entry->AddTransition(EPS_SYMBOL, automaton_.GetState(b.first[0]));
+            automaton_.GetState(a.last[0])->AddTransition(EPS_SYMBOL, exit);
+            automaton_.GetState(b.last[0])->AddTransition(EPS_SYMBOL, exit);
+            return result;
+        }
+
+        // Positions of different operands never coincide
+        a.first.insert(a.first.end(), b.first.begin(), b.first.end());
+        a.last.insert(a.last.end(), b.last.begin(), b.last.end());
+        a.nullable = a.nullable || b.nullable;
+        return a;
+    }
+
+    NFAFragment RegExpToNFAWalker::ProcessConcat(NFAFragment a, NFAFragment b) {
+        if (construction_ == NFAConstruction::Thompson) {
+            automaton_.GetState(a.last[0])->AddTransition(EPS_SYMBOL, automaton_.GetState(b.first[0]));
+            a.last = std::move(b.last);
+            return a;
+        }
+
+        Connect(a.last, b.first);
+
+        if (a.nullable) {
+            a.first.insert(a.first.end(), b.first.begin(), b.first.end());
+        }
+
+        if (b.nullable) {
+            b.last.insert(b.last.end(), a.last.begin(), a.last.end());
+        }
+
+        a.last = std::move(b.last);
+        a.nullable = a.nullable && b.nullable;
+        return a;
+    }
+
+    NFAFragment RegExpToNFAWalker::ProcessStar(NFAFragment a) {
+        if (construction_ == NFAConstruction::Thompson) {
+            NFAFragment result = NewThompsonFragment();
+            AutomatonState* entry = automaton_.GetState(result.first[0]);
+            AutomatonState* exit = automaton_.GetState(result.last[0]);
+            entry->AddTransition(EPS_SYMBOL, automaton_.GetState(a.first[0]));
+            entry->AddTransition(EPS_SYMBOL, exit);
+            automaton_.GetState(a.last[0])->AddTransition(EPS_SYMBOL, automaton_.GetState(a.first[0]));
+            automaton_.GetState(a.last[0])->AddTransition(EPS_SYMBOL, exit);
+            return result;
+        }
+
+        Connect(a.last, a.first);
+        a.nullable = true;
+        return a;
+    }
+
+    void RegExpToNFAWalker::Finish(const NFAFragment& result) {
+        if (construction_ == NFAConstruction::Thompson) {
+            automaton_.GetState(result.first[0])->MarkAsInitial();
+            automaton_.GetState(result.last[0])->MarkAsFinal();
+            return;
+        }
+
+        initial_state_->MarkAsInitial();
+        Connect({ initial_state_->GetNodeId() }, result.first);
+
+        for (StateId position : result.last) {
+            automaton_.GetState(position)->MarkAsFinal();
+        }
+
+        if (result.nullable) {
+            initial_state_->MarkAsFinal();
+        }
+    }
+
+    void RegExpToNFAWalker::Connect(const std::vector<StateId>& sources, const std::vector<StateId>& targets) {
+        for (StateId source : sources) {
+            AutomatonState* src_state = automaton_.GetState(source);
+            for (StateId target : targets) {
+                src_state->AddTransition(position_letters_[target], automaton_.GetState(target));
+            }
+        }
+    }
+
+    NFAFragment RegExpToNFAWalker::NewThompsonFragment() {
+        NFAFragment result;
+        result.first.push_back(automaton_.InsertState()->GetNodeId());
+        result.last.push_back(automaton_.InsertState()->GetNodeId());
         return result;
     }
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include <utility>
+#include <libformal/regexp_terms.hpp>
+
+namespace formal {
+    RegExpTermPool::RegExpTermPool() {
+        Intern({ TermKind::Empty, 0, 0, 0, false });
+        Intern({ TermKind::Epsilon, 0, 0, 0, true });
+    }
+
+    TermId RegExpTermPool::Letter(char letter) {
+        return Intern({ TermKind::Letter, letter, 0, 0, false });
+    }
+
+    TermId RegExpTermPool::Union(TermId a, TermId b) {
+        if (a == EMPTY_TERM || a == b) {
+            return b;
+        }
+
+        if (b == EMPTY_TERM) {
+            return a;
+        }
+
+        // Union is commutative, keep operands ordered to share more terms
+        if (a > b) {
+            std::swap(a, b);
+        }
+
+        return Intern({ TermKind::Union, 0, a, b, IsNullable(a) || IsNullable(b) });
+    }
+
+    TermId RegExpTermPool::Concat(TermId a, TermId b) {
+        if (a == EMPTY_TERM || b == EMPTY_TERM) {
+            return EMPTY_TERM;
+        }
+
+        if (a == EPSILON_TERM) {
+            return b;
+        }
+
+        if (b == EPSILON_TERM) {
+            return a;
+        }
+
+        return Intern({ TermKind::Concat, 0, a, b, IsNullable(a) && IsNullable(b) });
+    }
+
+    TermId RegExpTermPool::Star(TermId a) {
+        if (a == EMPTY_TERM || a == EPSILON_TERM) {
+            return EPSILON_TERM;
+        }
+
+        if (terms_[a].kind == TermKind::Star) {
+            return a;
+        }
+
+        return Intern({ TermKind::Star, 0, a, 0, true });
+    }
+
+    TermId RegExpTermPool::Intern(RegExpTerm term) {
+        auto [iter, inserted] = ids_.emplace(term, static_cast<TermId>(terms_.size()));
+        if (inserted) {
+            terms_.push_back(term);
+        }
+
+        return iter->second;
+    }
+}
@@ -1,5 +1,9 @@
+#include <libformal/algorithms.hpp>
+#include <libformal/derivative_matcher.hpp>
 #include <libformal/regexp_algorithms.hpp>
 #include <gtest/gtest.h>
+#include <random>
+#include "word_helpers.hpp"
 
 TEST(GeneralTest, RegExpTest1) {
     // Public test 1
@@ -43,4 +47,304 @@ TEST(GeneralTest, RegExpTest6) {
     EXPECT_ANY_THROW(formal::GetPrefixedMin(".", 'a', 1));
     EXPECT_ANY_THROW(formal::GetPrefixedMin("aa.*+", 'a', 1));
     EXPECT_ANY_THROW(formal::GetPrefixedMin("*", 'a', 1));
+}
+
+/// Restores infix form with every operator parenthesized. Not an IRegExpWalker
+struct InfixWalker {
+    std::string ProcessSingleLetter(char letter) {
+        return std::string(1, letter);
+    }
+
+    std::string ProcessEpsilon() {
+        return "1";
+    }
+
+    std::string ProcessUnion(std::string a, std::string b) {
+        return "(" + a + "+" + b + ")";
+    }
+
+    std::string ProcessConcat(std::string a, std::string b) {
+        return "(" + a + b + ")";
+    }
+
+    std::string ProcessStar(std::string a) {
+        return a + "*";
+    }
+};
+
+/// Counts symbols of a regexp, every distinct subexpression once
+struct SizeWalker {
+    static constexpr bool SHAREABLE_RESULTS = true;
+
+    int calls = 0;
+
+    int ProcessSingleLetter(char /*letter*/) {
+        calls++;
+        return 1;
+    }
+
+    int ProcessEpsilon() {
+        calls++;
+        return 1;
+    }
+
+    int ProcessUnion(int a, int b) {
+        calls++;
+        return a + b + 1;
+    }
+
+    int ProcessConcat(int a, int b) {
+        calls++;
+        return a + b + 1;
+    }
+
+    int ProcessStar(int a) {
+        calls++;
+        return a + 1;
+    }
+};
+
+TEST(GeneralTest, RegExpAstTest) {
+    formal::RegExpAst ast("ab+c.1*.");
+    ASSERT_EQ(ast.GetNodes().size(), 8);
+    EXPECT_EQ(ast.GetRoot(), 7);
+    EXPECT_EQ(ast.GetMaxDepth(), 2);
+
+    const formal::RegExpNode& concat = ast.GetNode(ast.GetRoot());
+    EXPECT_EQ(concat.kind, formal::RegExpNodeKind::Concat);
+    EXPECT_EQ(ast.GetNode(concat.lhs).kind, formal::RegExpNodeKind::Concat);
+    EXPECT_EQ(ast.GetNode(concat.rhs).kind, formal::RegExpNodeKind::Star);
+    EXPECT_EQ(ast.GetNode(ast.GetNode(concat.rhs).lhs).kind, formal::RegExpNodeKind::Epsilon);
+    EXPECT_EQ(ast.GetNode(1).letter, 'b');
+
+    InfixWalker infix;
+    EXPECT_EQ(formal::EvaluateRegExp(ast, infix), "(((a+b)c)1*)");
+
+    // Parsed once, evaluated by many walkers
+    formal::RegExpAst big("acb..bab.c.*.ab.ba.+.+*a.");
+    for (int count = 0; count < 5; count++) {
+        EXPECT_EQ(formal::GetPrefixedMin(big, 'b', count),
+                  formal::GetPrefixedMin("acb..bab.c.*.ab.ba.+.+*a.", 'b', count));
+    }
+
+    // Equal subexpressions share nodes, the tree is still there
+    formal::RegExpAst shared("ab.ab.+a*.");
+    EXPECT_EQ(shared.GetNodes().size(), 6);
+    EXPECT_EQ(shared.GetPostfix().size(), 10);
+    EXPECT_EQ(shared.GetNode(shared.GetRoot()).kind, formal::RegExpNodeKind::Concat);
+    EXPECT_EQ(formal::EvaluateRegExp(shared, infix), "(((ab)+(ab))a*)");
+
+    SizeWalker sizes;
+    EXPECT_EQ(formal::EvaluateRegExp(shared, sizes), 10);
+    EXPECT_EQ(sizes.calls, 6);
+
+    // Positions are per occurrence, not per distinct subexpression
+    EXPECT_EQ(formal::RegExpToNFA(shared).GetStates().size(), 6);
+
+    EXPECT_THROW(formal::RegExpAst("a+"), formal::RegExpProcessError);
+    EXPECT_THROW(formal::RegExpAst("*"), formal::RegExpProcessError);
+    EXPECT_THROW(formal::RegExpAst("ab"), formal::RegExpProcessError);
+    EXPECT_THROW(formal::RegExpAst(""), formal::RegExpProcessError);
+}
+
+/// Random regexp in RPN over {a, b, 1} with given count of letters
+std::string RandomRPNRegExp(int letters_count, std::mt19937& rng) {
+    if (letters_count == 1) {
+        std::string regexp(1, "aab1"[rng() % 4]);
+        return rng() % 3 == 0 ? regexp + "*" : regexp;
+    }
+
+    int lhs_count = 1 + rng() % (letters_count - 1);
+    std::string regexp = RandomRPNRegExp(lhs_count, rng) + RandomRPNRegExp(letters_count - lhs_count, rng);
+    regexp.push_back(rng() % 2 == 0 ? '+' : '.');
+    return rng() % 3 == 0 ? regexp + "*" : regexp;
+}
+
+/// Star as the sum of powers 1 + a + ... + a^count, everything else as is
+class PowerSumStarWalker {
+public:
+    PowerSumStarWalker(char letter, int count) : walker_(letter, count), count_(count) {}
+
+    formal::PrefixedMinResult ProcessSingleLetter(char letter) {
+        return walker_.ProcessSingleLetter(letter);
+    }
+
+    formal::PrefixedMinResult ProcessEpsilon() {
+        return walker_.ProcessEpsilon();
+    }
+
+    formal::PrefixedMinResult ProcessUnion(formal::PrefixedMinResult a, formal::PrefixedMinResult b) {
+        return walker_.ProcessUnion(std::move(a), std::move(b));
+    }
+
+    formal::PrefixedMinResult ProcessConcat(formal::PrefixedMinResult a, formal::PrefixedMinResult b) {
+        return walker_.ProcessConcat(std::move(a), std::move(b));
+    }
+
+    formal::PrefixedMinResult ProcessStar(formal::PrefixedMinResult a) {
+        formal::PrefixedMinResult result = walker_.ProcessEpsilon();
+        formal::PrefixedMinResult power = a;
+        for (int i = 0; i < count_; i++) {
+            result = walker_.ProcessUnion(result, power);
+            power = walker_.ProcessConcat(power, a);
+        }
+
+        return result;
+    }
+
+private:
+    formal::PrefixedMinWalker walker_;
+    int count_;
+};
+
+TEST(GeneralTest, PrefixedMinStarTest) {
+    std::mt19937 rng(22);
+    for (int iter = 0; iter < 300; iter++) {
+        formal::RegExpAst regexp(RandomRPNRegExp(1 + iter % 8, rng));
+        int count = iter % 9;
+
+        formal::PrefixedMinWalker walker('a', count);
+        PowerSumStarWalker power_sum('a', count);
+        formal::PrefixedMinResult result = formal::EvaluateRegExp(regexp, walker);
+        formal::PrefixedMinResult expected = formal::EvaluateRegExp(regexp, power_sum);
+        EXPECT_EQ(result.has_prefix, expected.has_prefix);
+        EXPECT_EQ(result.min_prefixed_len, expected.min_prefixed_len);
+    }
+
+    // Large counts are fine now: (aaa+b)*.(aa)* then b
+    EXPECT_EQ(formal::GetPrefixedMin("aaa..b+*aa.*.b.", 'a', 1000), 1001);
+    EXPECT_EQ(formal::GetPrefixedMin("aaa..b+*aa.*.", 'a', 1001), 1001);
+    EXPECT_EQ(formal::GetPrefixedMin("aa.*", 'a', 999), 1000);
+    EXPECT_EQ(formal::GetPrefixedMin("ab.*", 'a', 2), formal::INT_NONE);
+}
+
+TEST(GeneralTest, BitsetOrShiftedTest) {
+    std::mt19937 rng(24);
+    for (size_t size : { 1, 63, 64, 65, 200 }) {
+        formal::DynamicBitset bits(size);
+        for (size_t i = 0; i < size; i++) {
+            if (rng() % 3 == 0) {
+                bits.Set(i);
+            }
+        }
+
+        for (size_t shift : { size_t(0), size_t(1), size_t(63), size_t(64), size_t(65), size }) {
+            formal::DynamicBitset shifted(size);
+            shifted.Set(size - 1);
+            formal::DynamicBitset expected = shifted;
+            shifted.OrShifted(bits, shift);
+            for (size_t i = shift; i < size; i++) {
+                if (bits.Test(i - shift)) {
+                    expected.Set(i);
+                }
+            }
+
+            EXPECT_EQ(shifted, expected) << size << " " << shift;
+
+            // Shifting into itself
+            formal::DynamicBitset self = bits;
+            self.OrShifted(self, shift);
+            expected = bits;
+            for (size_t i = shift; i < size; i++) {
+                if (bits.Test(i - shift)) {
+                    expected.Set(i);
+                }
+            }
+
+            EXPECT_EQ(self, expected) << size << " " << shift;
+        }
+    }
+}
+
+TEST(GeneralTest, PrefixedMinTableTest) {
+    std::mt19937 rng(23);
+    std::vector<std::string> regexps = { "ab+c.aba.*.bac.+.+*", "acb..bab.c.*.ab.ba.+.+*a.", "aa.b.*cc..",
+                                         "aaba...aba..+1+", "aa.1+", "1*" };
+    for (int iter = 0; iter < 30; iter++) {
+        regexps.push_back(RandomRPNRegExp(1 + iter % 10, rng));
+    }
+
+    for (const std::string& regexp : regexps) {
+        formal::PrefixedMinTable table = formal::GetPrefixedMinTable(regexp, 6);
+        EXPECT_EQ(table.GetCount(), 6);
+        for (char letter : { 'a', 'b', 'c', 'z' }) {
+            for (int count = 0; count <= 6; count++) {
+                EXPECT_EQ(table.Get(letter, count), formal::GetPrefixedMin(regexp, letter, count))
+                    << regexp << " " << letter << " " << count;
+            }
+        }
+    }
+
+    formal::PrefixedMinTable table = formal::GetPrefixedMinTable("acb..bab.c.*.ab.ba.+.+*a.", 2);
+    EXPECT_EQ(std::string(table.GetLetters().begin(), table.GetLetters().end()), "abc");
+    EXPECT_EQ(table.Get('b', 2), 4);
+}
+
+TEST(GeneralTest, SharedSubexpressionsTest) {
+    // r(i+1) = (r(i) + 1)(r(i) + 1) accepts a^n for n <= 2^(i+1). Tree doubles, distinct subexpressions don't
+    std::string regexp = "a";
+    std::string smaller;
+    for (int i = 0; i < 14; i++) {
+        regexp = regexp + "1+" + regexp + "1+.";
+        if (i == 9) {
+            smaller = regexp;
+        }
+    }
+
+    formal::RegExpAst ast(regexp);
+    EXPECT_EQ(ast.GetNodes().size(), 2 + 14 * 2);
+    EXPECT_EQ(formal::GetPrefixedMin(ast, 'a', 0), 0);
+    EXPECT_EQ(formal::GetPrefixedMin(ast, 'a', 100), 100);
+    EXPECT_EQ(formal::GetPrefixedMinTable(ast, 5).Get('a', 5), 5);
+
+    EXPECT_EQ(formal::GetPrefixedMin(smaller, 'a', 1024), 1024);
+    EXPECT_EQ(formal::GetPrefixedMin(smaller, 'a', 1025), formal::INT_NONE);
+}
+
+TEST(GeneralTest, RegExpToNFATest) {
+    // (a+b)*.a.b.(1+c)*
+    formal::Automaton glushkov = formal::RegExpToNFA("ab+*a.b.1c+*.");
+    EXPECT_TRUE(glushkov.HasNoEpsTransitions());
+    EXPECT_EQ(glushkov.GetStates().size(), 6);
+
+    EXPECT_TRUE(formal::NFAReadWord(glushkov, "ab"));
+    EXPECT_TRUE(formal::NFAReadWord(glushkov, "babbabcc"));
+    EXPECT_FALSE(formal::NFAReadWord(glushkov, "ba"));
+    EXPECT_FALSE(formal::NFAReadWord(glushkov, "abcb"));
+    EXPECT_FALSE(formal::NFAReadWord(glushkov, ""));
+
+    std::vector<std::string> regexps = { "ab+c.aba.*.bac.+.+*", "acb..bab.c.*.ab.ba.+.+*a.", "aa.b.*cc..",
+                                         "aaba...aba..+1+", "aa.1+", "1*", "a**b*+*c." };
+    for (const std::string& regexp : regexps) {
+        formal::Automaton glushkov = formal::RegExpToNFA(regexp);
+        formal::Automaton thompson = formal::RegExpToNFA(regexp, formal::NFAConstruction::Thompson);
+        formal::RemoveEpsTransitions(thompson);
+
+        ForEachWord("abc", 6, [&](const std::string& word) {
+            EXPECT_EQ(formal::NFAReadWord(glushkov, word), formal::NFAReadWord(thompson, word))
+                << regexp << " " << word;
+        });
+    }
+
+    EXPECT_ANY_THROW(formal::RegExpToNFA("aa.*+"));
+}
+
+TEST(GeneralTest, DerivativeMatcherTest) {
+    std::vector<std::string> regexps = { "ab+*a.b.1c+*.", "ab+c.aba.*.bac.+.+*", "acb..bab.c.*.ab.ba.+.+*a.",
+                                         "aa.b.*cc..", "aaba...aba..+1+", "1*", "a**b*+*c." };
+    for (const std::string& regexp : regexps) {
+        formal::DerivativeMatcher matcher(regexp);
+        formal::Automaton glushkov = formal::RegExpToNFA(regexp);
+
+        ForEachWord("abc", 7, [&](const std::string& word) {
+            EXPECT_EQ(matcher.Match(word), formal::NFAReadWord(glushkov, word)) << regexp << " " << word;
+        });
+    }
+
+    // Partial derivatives of (a+b)*.a.b are finitely many
+    formal::DerivativeMatcher matcher("ab+*a.b.");
+    EXPECT_TRUE(matcher.Match(std::string(1000, 'a') + "b"));
+    EXPECT_LE(matcher.GetStatesCount(), 5);
+
+    EXPECT_ANY_THROW(formal::DerivativeMatcher("a."));
 }
\ No newline at end of file
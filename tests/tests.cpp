@@ -1,7 +1,15 @@
 #include <libformal/algorithms.hpp>
 #include <libformal/automaton_state.hpp>
+#include <libformal/compiled_dfa.hpp>
+#include <libformal/lazy_dfa.hpp>
+#include <libformal/nfa_matcher.hpp>
+#include <libformal/product_matcher.hpp>
+#include <libformal/regexp_algorithms.hpp>
 #include <gtest/gtest.h>
+#include <optional>
+#include <random>
 #include <fmt/core.h>
+#include "word_helpers.hpp"
 
 void Hw4Task5Aut(formal::Automaton& aut) {
     // hw4 task5 automaton
@@ -52,6 +60,24 @@ void Hw4Task6Aut(formal::Automaton& aut) {
     s4->MarkAsFinal();
 }
 
+void RandomCDFA(formal::Automaton& aut, int states_count, std::mt19937& rng) {
+    std::vector<formal::AutomatonState*> states;
+    for (int i = 0; i < states_count; i++) {
+        states.push_back(aut.InsertState());
+        if (rng() % 3 == 0) {
+            states.back()->MarkAsFinal();
+        }
+    }
+
+    for (formal::AutomatonState* state : states) {
+        for (char letter : aut.GetAlphabet()) {
+            state->AddTransition(std::string(1, letter), states[rng() % states_count]);
+        }
+    }
+
+    states[0]->MarkAsInitial();
+}
+
 TEST(GeneralTest, Hw3Task1Test) {
     // hw3 task1 automaton
     formal::Automaton aut;
@@ -297,6 +323,113 @@ TEST(GeneralTest, RegExpGenTest2) {
     ASSERT_EQ(regexp, "(aa)*ab(bb+cc)*(ba(aa)*ab(bb+cc)*)*");
 }
 
+// Recursive descent over NFAToRegExp output: sum of products of letters, 1 and (x)*
+std::string InfixToRPN(const std::string& regexp, size_t& pos) {
+    std::string sum;
+    bool sum_started = false;
+    while (true) {
+        std::string product;
+        bool product_started = false;
+        while (pos < regexp.size() && regexp[pos] != '+' && regexp[pos] != ')') {
+            std::string factor;
+            if (regexp[pos] == '(') {
+                pos++;
+                factor = InfixToRPN(regexp, pos);
+                pos++;
+            } else {
+                factor = regexp.substr(pos++, 1);
+            }
+
+            for (; pos < regexp.size() && regexp[pos] == '*'; pos++) {
+                factor.push_back('*');
+            }
+
+            product = product_started ? product + factor + "." : factor;
+            product_started = true;
+        }
+
+        sum = sum_started ? sum + product + "+" : product;
+        sum_started = true;
+        if (pos == regexp.size() || regexp[pos] != '+') {
+            return sum;
+        }
+
+        pos++;
+    }
+}
+
+TEST(GeneralTest, RegExpGenOrderTest) {
+    size_t legacy_size = 0;
+    size_t min_weight_size = 0;
+
+    for (int iter = 0; iter < 10; iter++) {
+        std::vector<std::string> regexps;
+        for (auto order : { formal::EliminationOrder::Legacy, formal::EliminationOrder::MinDegree,
+                            formal::EliminationOrder::MinWeight }) {
+            std::mt19937 aut_rng(iter);
+            formal::Automaton aut;
+            std::vector<formal::AutomatonState*> states;
+            for (int i = 0; i < 8; i++) {
+                states.push_back(aut.InsertState());
+                if (aut_rng() % 3 == 0) {
+                    states.back()->MarkAsFinal();
+                }
+            }
+
+            states[0]->MarkAsInitial();
+            states[7]->MarkAsFinal();
+            for (formal::AutomatonState* state : states) {
+                state->AddTransition("a", states[aut_rng() % 8]);
+                state->AddTransition("b", states[aut_rng() % 8]);
+            }
+
+            regexps.push_back(formal::NFAToRegExp(aut, order));
+        }
+
+        legacy_size += regexps[0].size();
+        min_weight_size += regexps[2].size();
+
+        // Same language whatever the order is
+        std::vector<formal::Automaton> nfas;
+        for (const std::string& regexp : regexps) {
+            size_t pos = 0;
+            nfas.push_back(formal::RegExpToNFA(InfixToRPN(regexp, pos)));
+        }
+
+        ForEachWord("ab", 8, [&](const std::string& word) {
+            bool accepted = formal::NFAReadWord(nfas[0], word);
+            EXPECT_EQ(formal::NFAReadWord(nfas[1], word), accepted);
+            EXPECT_EQ(formal::NFAReadWord(nfas[2], word), accepted);
+        });
+    }
+
+    EXPECT_LT(min_weight_size, legacy_size);
+}
+
+TEST(GeneralTest, RegExpGenSharedTest) {
+    formal::Automaton aut;
+
+    formal::AutomatonState* initial = aut.InsertState();
+    formal::AutomatonState* upper = aut.InsertState();
+    formal::AutomatonState* lower = aut.InsertState();
+    formal::AutomatonState* middle = aut.InsertState();
+    formal::AutomatonState* final = aut.InsertState();
+
+    initial->MarkAsInitial();
+    final->MarkAsFinal();
+
+    // Both paths give the same shortcut, eps-transitions vanish
+    initial->AddTransition("a", upper);
+    initial->AddTransition("a", lower);
+    upper->AddTransition("b", middle);
+    lower->AddTransition("b", middle);
+    middle->AddTransition("", final);
+    final->AddTransition("", final);
+
+    std::string regexp = formal::NFAToRegExp(aut);
+    EXPECT_EQ(regexp, "ab");
+}
+
 TEST(GeneralTest, Test1) {
     formal::Automaton aut;
 
@@ -349,4 +482,749 @@ TEST(GeneralTest, Test1) {
     EXPECT_TRUE(formal::DFAReadWord(aut, ""));
     EXPECT_TRUE(formal::DFAReadWord(aut, "abababa"));
     EXPECT_TRUE(formal::DFAReadWord(aut, "bab"));
-}
\ No newline at end of file
+}
+
+TEST(GeneralTest, CompiledDFATest) {
+    formal::Automaton aut;
+    Hw4Task6Aut(aut);
+
+    formal::RemoveEpsTransitions(aut);
+    formal::TransformToDFA(aut);
+
+    formal::CompiledDFA compiled(aut);
+    EXPECT_TRUE(compiled.Match("aabbabaabbbabaaaaaabaaabbabaabbbabaaaaaabaaabbabaabbbabaaaaaaba"));
+    EXPECT_TRUE(compiled.Match("abababaaa"));
+    EXPECT_FALSE(compiled.Match("aababababaabbabababababbababba"));
+    EXPECT_FALSE(compiled.Match(""));
+    EXPECT_FALSE(compiled.Match("abababaaac"));
+
+    // Exhaustive check against DFAReadWord on all short words
+    ForEachWord("ab", 10, [&](const std::string& word) {
+        EXPECT_EQ(compiled.Match(word), formal::DFAReadWord(aut, word));
+    });
+
+    formal::CompleteDFA(aut);
+    formal::ComplementCDFA(aut);
+    formal::MinimizeCDFA(aut);
+
+    formal::CompiledDFA compiled_min(aut);
+    EXPECT_FALSE(compiled_min.Match("abababaaa"));
+    EXPECT_TRUE(compiled_min.Match("aababababaabbabababababbababba"));
+    EXPECT_TRUE(compiled_min.Match(""));
+}
+
+TEST(GeneralTest, MatchBatchTest) {
+    std::mt19937 rng(17);
+    formal::Automaton aut;
+    RandomCDFA(aut, 12, rng);
+
+    formal::CompiledDFA compiled(aut);
+
+    // Lengths vary a lot so lanes finish at different times, including empty words
+    std::vector<std::string> words;
+    for (int i = 0; i < 1000; i++) {
+        std::string word;
+        int len = rng() % 4 == 0 ? 0 : rng() % (i % 7 == 0 ? 200 : 20);
+        for (int j = 0; j < len; j++) {
+            word.push_back(rng() % 2 == 0 ? 'a' : 'b');
+        }
+
+        words.push_back(word);
+    }
+
+    for (size_t count : { size_t(0), size_t(1), size_t(15), size_t(16), size_t(17), words.size() }) {
+        std::vector<std::string_view> views(words.begin(), words.begin() + count);
+        formal::DynamicBitset accepted = compiled.MatchBatch(views);
+        ASSERT_EQ(accepted.Size(), count);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(accepted.Test(i), compiled.Match(words[i])) << words[i];
+        }
+    }
+}
+
+TEST(GeneralTest, ParallelMatchTest) {
+    std::mt19937 rng(18);
+    for (int iter = 0; iter < 4; iter++) {
+        formal::Automaton aut;
+        RandomCDFA(aut, 3 + iter * 5, rng);
+        formal::MinimizeCDFA(aut);
+        formal::CompiledDFA compiled(aut);
+
+        // Long enough for 8 chunks, the last one is shorter than the rest
+        std::string word;
+        for (size_t i = 0; i < formal::CompiledDFA::MIN_PARALLEL_CHUNK * 8 + 123; i++) {
+            word.push_back(rng() % 2 == 0 ? 'a' : 'b');
+        }
+
+        for (size_t len : { word.size(), word.size() / 2, size_t(1000) }) {
+            std::string_view prefix(word.data(), len);
+            bool expected = compiled.Match(prefix);
+            for (int threads_count : { -1, 0, 1, 2, 3, 8 }) {
+                EXPECT_EQ(compiled.ParallelMatch(prefix, threads_count), expected);
+            }
+        }
+    }
+}
+
+TEST(GeneralTest, ShuffleEngineTest) {
+#if defined(__x86_64__) || defined(__i386__)
+    bool shuffle_supported = __builtin_cpu_supports("ssse3");
+#else
+    bool shuffle_supported = false;
+#endif
+
+    std::mt19937 rng(19);
+    for (int states_count = 1; states_count <= 17; states_count++) {
+        for (bool complete : { false, true }) {
+            formal::Automaton aut;
+            RandomCDFA(aut, states_count, rng);
+
+            // Missing transition leads to the dead state, which takes a lane unless all states lack it
+            int lanes_count = states_count;
+            if (!complete) {
+                formal::AutomatonState* state = aut.GetStates()[rng() % states_count];
+                state->RemoveTransition("a", state->FindTransition(formal::LetterToSymbol('a')));
+                lanes_count += states_count > 1;
+            }
+
+            formal::CompiledDFA compiled(aut);
+            EXPECT_EQ(compiled.UsesShuffleEngine(),
+                      shuffle_supported && lanes_count <= formal::CompiledDFA::SHUFFLE_MAX_STATES)
+                << states_count << " " << complete;
+
+            // Letters outside the alphabet lead every state to the dead one
+            for (int iter = 0; iter < 200; iter++) {
+                std::string word;
+                int len = rng() % 40;
+                for (int i = 0; i < len; i++) {
+                    word.push_back("aaaabbbbbc"[rng() % 10]);
+                }
+
+                EXPECT_EQ(compiled.Match(word), formal::DFAReadWord(aut, word)) << word;
+            }
+
+            // Runs from all states in one vector
+            std::string word(formal::CompiledDFA::MIN_PARALLEL_CHUNK * 2, 'a');
+            for (char& letter : word) {
+                letter = rng() % 2 == 0 ? 'a' : 'b';
+            }
+
+            for (size_t pos : { word.size() - 1, word.size() / 2 + 1, size_t(0) }) {
+                EXPECT_EQ(compiled.ParallelMatch(word, 2), compiled.Match(word));
+                word[pos] = 'c';
+            }
+        }
+    }
+}
+
+TEST(GeneralTest, StateArenaTest) {
+    formal::Automaton aut;
+
+    std::vector<formal::AutomatonState*> states;
+    for (int i = 0; i < 1000; i++) {
+        states.push_back(aut.InsertState());
+        EXPECT_EQ(states.back()->GetNodeId(), i);
+    }
+
+    for (int i = 0; i + 1 < 1000; i++) {
+        states[i]->AddTransition("a", states[i + 1]);
+    }
+
+    states[0]->MarkAsInitial();
+    states[999]->MarkAsFinal();
+    states[500]->Remove();
+
+    EXPECT_EQ(aut.GetStates().size(), 999);
+    EXPECT_EQ(aut.GetStateIdBound(), 1000);
+    EXPECT_EQ(aut.GetState(500), nullptr);
+    EXPECT_EQ(aut.GetState(501), states[501]);
+    EXPECT_FALSE(states[499]->TransitionPresent("a", states[501]));
+
+    formal::Automaton moved(std::move(aut));
+    EXPECT_TRUE(moved.Belongs(states[42]));
+    EXPECT_FALSE(aut.Belongs(states[42]));
+
+    formal::Optimize(moved);
+    EXPECT_EQ(moved.GetStates().size(), 500);
+    EXPECT_TRUE(moved.GetFinalStates().empty());
+}
+
+TEST(GeneralTest, CompactTransitionsTest) {
+    formal::Automaton aut;
+
+    auto s1 = aut.InsertState();
+    auto s2 = aut.InsertState();
+
+    s1->AddTransition("a", s2);
+    s1->AddTransition("ab", s2);
+    s1->AddTransition("ab", s1);
+    s1->AddTransition("", s2);
+    s1->AddTransition("a", s2);
+
+    EXPECT_EQ(aut.InternWord("a"), formal::LetterToSymbol('a'));
+    EXPECT_EQ(aut.InternWord(""), formal::EPS_SYMBOL);
+    EXPECT_EQ(aut.FindWord("ab"), aut.InternWord("ab"));
+    EXPECT_EQ(aut.FindWord("ba"), formal::NO_SYMBOL);
+    EXPECT_EQ(aut.GetWord(aut.FindWord("ab")), "ab");
+
+    EXPECT_EQ(s1->GetTransitions().size(), 4);
+    EXPECT_TRUE(s1->TransitionPresent("ab", s1));
+    EXPECT_FALSE(s1->TransitionPresent("ba", s1));
+    EXPECT_EQ(s1->FindTransition(formal::LetterToSymbol('a')), s2);
+    EXPECT_EQ(s1->FindTransition(formal::LetterToSymbol('b')), nullptr);
+
+    // Back transitions are built on demand and kept in sync afterwards
+    EXPECT_EQ(s2->GetBackTransitions().size(), 3);
+    s1->RemoveTransition("ab", s2);
+    EXPECT_EQ(s2->GetBackTransitions().size(), 2);
+    s2->AddTransition("b", s2);
+    EXPECT_EQ(s2->GetBackTransitions().size(), 3);
+
+    s1->Remove();
+    EXPECT_EQ(s2->GetBackTransitions().size(), 1);
+    EXPECT_EQ(s2->GetBackTransitions().begin()->first, "b");
+    EXPECT_EQ(s2->GetBackTransitions().begin()->second, s2);
+}
+
+TEST(GeneralTest, HopcroftMinimizeTest) {
+    std::mt19937 rng(42);
+    for (int iter = 0; iter < 50; iter++) {
+        formal::Automaton original;
+        formal::Automaton moore;
+        formal::Automaton hopcroft;
+
+        // Same automaton three times
+        std::mt19937 rng_copy1 = rng;
+        std::mt19937 rng_copy2 = rng;
+        RandomCDFA(original, 30, rng);
+        RandomCDFA(moore, 30, rng_copy1);
+        RandomCDFA(hopcroft, 30, rng_copy2);
+
+        formal::Optimize(moore);
+        formal::MinimizeCDFA(moore, formal::MinimizationAlgorithm::Moore);
+        formal::MinimizeCDFA(hopcroft, formal::MinimizationAlgorithm::Hopcroft);
+
+        EXPECT_TRUE(formal::IsCDFA(hopcroft));
+        EXPECT_EQ(moore.GetStates().size(), hopcroft.GetStates().size());
+        ExpectSameLanguage(original, hopcroft, 8);
+    }
+}
+
+TEST(GeneralTest, VirtualSinkTest) {
+    formal::Automaton aut_real;
+    formal::Automaton aut_virtual;
+    Hw4Task5Aut(aut_real);
+    Hw4Task5Aut(aut_virtual);
+
+    for (formal::Automaton* aut : { &aut_real, &aut_virtual }) {
+        formal::RemoveEpsTransitions(*aut);
+        formal::TransformToDFA(*aut);
+    }
+
+    formal::CompleteDFA(aut_real);
+    formal::CompleteDFA(aut_virtual, true);
+    EXPECT_TRUE(formal::IsCDFA(aut_virtual));
+    EXPECT_EQ(aut_virtual.GetImplicitSink(), formal::ImplicitSink::Rejecting);
+    EXPECT_EQ(aut_virtual.GetStates().size() + 1, aut_real.GetStates().size());
+
+    formal::ComplementCDFA(aut_real);
+    formal::ComplementCDFA(aut_virtual);
+    EXPECT_EQ(aut_virtual.GetImplicitSink(), formal::ImplicitSink::Accepting);
+    ExpectSameLanguage(aut_real, aut_virtual, 10);
+
+    formal::MinimizeCDFA(aut_real);
+    formal::MinimizeCDFA(aut_virtual);
+    EXPECT_EQ(aut_virtual.GetStates().size() + 1, aut_real.GetStates().size());
+    ExpectSameLanguage(aut_real, aut_virtual, 10);
+
+    formal::CompiledDFA compiled(aut_virtual);
+    EXPECT_TRUE(compiled.Match("abababababa"));
+    EXPECT_TRUE(compiled.Match("aabab"));
+    EXPECT_FALSE(compiled.Match("aaaaaaaabaaba"));
+
+    // Materializing the sink gives the usual CDFA back
+    formal::CompleteDFA(aut_virtual);
+    EXPECT_EQ(aut_virtual.GetImplicitSink(), formal::ImplicitSink::None);
+    EXPECT_TRUE(formal::IsCDFA(aut_virtual));
+    ExpectSameLanguage(aut_real, aut_virtual, 10);
+}
+
+TEST(GeneralTest, PartialMinimizeTest) {
+    std::mt19937 rng(7);
+    for (int iter = 0; iter < 50; iter++) {
+        formal::Automaton partial;
+        formal::Automaton complete;
+
+        std::mt19937 rng_copy = rng;
+        RandomCDFA(partial, 30, rng);
+        RandomCDFA(complete, 30, rng_copy);
+
+        // Drop some transitions from both
+        for (formal::Automaton* aut : { &partial, &complete }) {
+            for (formal::AutomatonState* state : aut->GetStates()) {
+                if (state->GetNodeId() % 4 == 1) {
+                    formal::AutomatonState* dst_state = state->FindTransition(formal::LetterToSymbol('a'));
+                    state->RemoveTransition(formal::LetterToSymbol('a'), dst_state);
+                }
+            }
+        }
+
+        formal::MinimizeDFA(partial);
+        formal::CompleteDFA(complete);
+        formal::MinimizeCDFA(complete);
+
+        EXPECT_TRUE(partial.IsDFA());
+        EXPECT_LE(partial.GetStates().size(), complete.GetStates().size());
+        EXPECT_GE(partial.GetStates().size() + 1, complete.GetStates().size());
+        ExpectSameLanguage(partial, complete, 8);
+    }
+}
+
+TEST(GeneralTest, SubsetConstructionBlowupTest) {
+    // k-th letter from the end is 'a': DFA needs 2^k states
+    const int k = 10;
+    formal::Automaton aut;
+
+    std::vector<formal::AutomatonState*> states;
+    for (int i = 0; i <= k; i++) {
+        states.push_back(aut.InsertState());
+    }
+
+    states[0]->MarkAsInitial();
+    states[k]->MarkAsFinal();
+    states[0]->AddTransition("a", states[0]);
+    states[0]->AddTransition("b", states[0]);
+    states[0]->AddTransition("a", states[1]);
+    for (int i = 1; i < k; i++) {
+        states[i]->AddTransition("a", states[i + 1]);
+        states[i]->AddTransition("b", states[i + 1]);
+    }
+
+    formal::TransformToDFA(aut);
+    EXPECT_TRUE(aut.IsDFA());
+    EXPECT_EQ(aut.GetStates().size(), 1 << k);
+
+    EXPECT_TRUE(formal::DFAReadWord(aut, "abbbbbbbbb"));
+    EXPECT_TRUE(formal::DFAReadWord(aut, "bbbbabbbbbbbbb"));
+    EXPECT_FALSE(formal::DFAReadWord(aut, "bbbbbbbbbb"));
+    EXPECT_FALSE(formal::DFAReadWord(aut, "abbbbbbbb"));
+
+    formal::MinimizeDFA(aut);
+    EXPECT_EQ(aut.GetStates().size(), 1 << k);
+}
+
+TEST(GeneralTest, ParallelSubsetConstructionTest) {
+    const int k = 9;
+    auto build_nfa = [&]() {
+        formal::Automaton aut;
+        std::vector<formal::AutomatonState*> states;
+        for (int i = 0; i <= k; i++) {
+            states.push_back(aut.InsertState());
+        }
+
+        states[0]->MarkAsInitial();
+        states[k]->MarkAsFinal();
+        states[0]->AddTransition("a", states[0]);
+        states[0]->AddTransition("b", states[0]);
+        states[0]->AddTransition("a", states[1]);
+        for (int i = 1; i < k; i++) {
+            states[i]->AddTransition("a", states[i + 1]);
+            states[i]->AddTransition(i % 2 == 0 ? "a" : "b", states[i + 1]);
+        }
+
+        return aut;
+    };
+
+    formal::Automaton sequential = build_nfa();
+    formal::TransformToDFA(sequential);
+
+    for (int threads : { 2, 4, 8 }) {
+        formal::Automaton parallel = build_nfa();
+        formal::TransformToDFA(parallel, threads);
+
+        // Same numbering, labels and transitions as the sequential result
+        ASSERT_EQ(parallel.GetStates().size(), sequential.GetStates().size());
+        EXPECT_EQ(parallel.GetInitialState()->GetNodeId(), sequential.GetInitialState()->GetNodeId());
+        for (formal::AutomatonState* state : sequential.GetStates()) {
+            formal::AutomatonState* other = parallel.GetState(state->GetNodeId());
+            ASSERT_NE(other, nullptr);
+            EXPECT_EQ(other->GetLabel(), state->GetLabel());
+            EXPECT_EQ(other->IsFinal(), state->IsFinal());
+            EXPECT_EQ(other->GetEdges(), state->GetEdges());
+        }
+    }
+}
+
+TEST(GeneralTest, LazyDFATest) {
+    // k-th letter from the end is 'a': DFA needs 2^k states
+    const int k = 12;
+    formal::Automaton nfa;
+
+    std::vector<formal::AutomatonState*> states;
+    for (int i = 0; i <= k; i++) {
+        states.push_back(nfa.InsertState());
+    }
+
+    states[0]->MarkAsInitial();
+    states[k]->MarkAsFinal();
+    states[0]->AddTransition("a", states[0]);
+    states[0]->AddTransition("b", states[0]);
+    states[0]->AddTransition("a", states[1]);
+    for (int i = 1; i < k; i++) {
+        states[i]->AddTransition("a", states[i + 1]);
+        states[i]->AddTransition("b", states[i + 1]);
+    }
+
+    formal::LazyDFA lazy(nfa);
+    // Room for a handful of states only
+    formal::LazyDFA tiny(nfa, 16 * formal::LazyDFA::ROW_SIZE * sizeof(formal::LazyDFA::StateIndex));
+
+    // Lazy matchers keep their own copy of the NFA
+    formal::TransformToDFA(nfa);
+    formal::CompiledDFA compiled(nfa);
+
+    std::mt19937 rng(7);
+    for (int iter = 0; iter < 300; iter++) {
+        std::string word;
+        int len = rng() % 40;
+        for (int i = 0; i < len; i++) {
+            word.push_back("abc"[rng() % (iter % 10 == 0 ? 3 : 2)]);
+        }
+
+        EXPECT_EQ(lazy.Match(word), compiled.Match(word));
+        EXPECT_EQ(tiny.Match(word), compiled.Match(word));
+    }
+
+    EXPECT_EQ(lazy.GetFlushesCount(), 0);
+    EXPECT_GT(tiny.GetFlushesCount(), 0);
+    EXPECT_LE(tiny.GetCachedStatesCount(), 16);
+}
+
+TEST(GeneralTest, EpsCycleClosureTest) {
+    formal::Automaton aut;
+    std::vector<formal::AutomatonState*> states;
+    for (int i = 0; i < 5; i++) {
+        states.push_back(aut.InsertState());
+    }
+
+    // Every state of the eps-cycle must see both letter transitions
+    states[0]->AddTransition("", states[1]);
+    states[1]->AddTransition("", states[2]);
+    states[2]->AddTransition("", states[0]);
+    states[2]->AddTransition("a", states[3]);
+    states[1]->AddTransition("b", states[4]);
+    states[3]->MarkAsFinal();
+    states[4]->MarkAsFinal();
+    states[2]->MarkAsInitial();
+
+    formal::RemoveEpsTransitions(aut);
+    formal::TransformToDFA(aut);
+
+    EXPECT_TRUE(formal::DFAReadWord(aut, "a"));
+    EXPECT_TRUE(formal::DFAReadWord(aut, "b"));
+    EXPECT_FALSE(formal::DFAReadWord(aut, ""));
+    EXPECT_FALSE(formal::DFAReadWord(aut, "ab"));
+}
+
+TEST(GeneralTest, LongEpsChainTest) {
+    // Thompson-like chain a(eps)a(eps)...: too deep for recursion
+    const int n = 100000;
+    formal::Automaton aut;
+
+    formal::AutomatonState* state = aut.InsertState();
+    state->MarkAsInitial();
+    for (int i = 0; i < n; i++) {
+        formal::AutomatonState* letter_dst = aut.InsertState();
+        formal::AutomatonState* eps_dst = aut.InsertState();
+        state->AddTransition("a", letter_dst);
+        letter_dst->AddTransition("", eps_dst);
+        state = eps_dst;
+    }
+
+    state->MarkAsFinal();
+    formal::RemoveEpsTransitions(aut);
+
+    EXPECT_TRUE(aut.HasNoEpsTransitions());
+    EXPECT_EQ(aut.GetStates().size(), n + 1);
+    EXPECT_TRUE(formal::DFAReadWord(aut, std::string(n, 'a')));
+    EXPECT_FALSE(formal::DFAReadWord(aut, std::string(n - 1, 'a')));
+}
+
+TEST(GeneralTest, NFAMatcherTest) {
+    std::mt19937 rng(13);
+
+    for (int iter = 0; iter < 40; iter++) {
+        // Every odd automaton is Glushkov-style: all transitions into a state share the letter
+        bool homogeneous = iter % 2 == 1;
+        const int n = 10 + iter * 3;
+
+        formal::Automaton nfa;
+        std::vector<formal::AutomatonState*> states;
+        for (int i = 0; i < n; i++) {
+            states.push_back(nfa.InsertState());
+            if (rng() % 4 == 0) {
+                states.back()->MarkAsFinal();
+            }
+        }
+
+        states[0]->MarkAsInitial();
+        for (int i = 0; i < n * 2; i++) {
+            int dst = rng() % n;
+            const char* letter = homogeneous ? (dst % 2 == 0 ? "a" : "b") : (rng() % 2 == 0 ? "a" : "b");
+            states[rng() % n]->AddTransition(letter, states[dst]);
+        }
+
+        formal::NFAMatcher matcher(nfa);
+        formal::NFAMatcher scatter_matcher(nfa, 0);
+
+        std::vector<std::string> words;
+        for (int i = 0; i < 100; i++) {
+            std::string word;
+            int len = rng() % 20;
+            for (int j = 0; j < len; j++) {
+                word.push_back(rng() % 2 == 0 ? 'a' : 'b');
+            }
+
+            words.push_back(word);
+        }
+
+        std::vector<bool> nfa_results;
+        for (const std::string& word : words) {
+            nfa_results.push_back(matcher.Match(word));
+            EXPECT_EQ(scatter_matcher.Match(word), nfa_results.back());
+        }
+
+        EXPECT_EQ(formal::NFAReadWord(nfa, words[0]), nfa_results[0]);
+
+        formal::TransformToDFA(nfa);
+        for (size_t i = 0; i < words.size(); i++) {
+            EXPECT_EQ(formal::DFAReadWord(nfa, words[i]), nfa_results[i]);
+        }
+    }
+}
+
+TEST(GeneralTest, ByteClassesTest) {
+    formal::LetterSet letters = { 'd', 'a', '\xff', 'c' };
+    EXPECT_EQ(std::string(letters.begin(), letters.end()), "acd\xff");
+    EXPECT_EQ(letters.Size(), 4);
+    EXPECT_TRUE(letters.Contains('c'));
+    EXPECT_FALSE(letters.Contains('b'));
+
+    // Counts digits mod 2 over a full byte alphabet, all non-digits are alike
+    formal::LetterSet alphabet;
+    for (int byte = 0; byte < 256; byte++) {
+        alphabet.Insert(static_cast<char>(byte));
+    }
+
+    formal::Automaton aut(alphabet);
+    std::vector<formal::AutomatonState*> states;
+    for (int i = 0; i < 4; i++) {
+        states.push_back(aut.InsertState());
+    }
+
+    // States 2 and 3 duplicate 0 and 1
+    for (int i = 0; i < 4; i++) {
+        for (char letter : alphabet) {
+            bool digit = '0' <= letter && letter <= '9';
+            states[i]->AddTransition(formal::LetterToSymbol(letter), states[digit ? (i + 1) % 4 : i]);
+        }
+    }
+
+    states[0]->MarkAsInitial();
+    states[0]->MarkAsFinal();
+    states[2]->MarkAsFinal();
+
+    formal::ByteClasses classes(aut);
+    EXPECT_EQ(classes.GetClassesCount(), 2);
+    EXPECT_EQ(classes.GetClass('0'), classes.GetClass('9'));
+    EXPECT_EQ(classes.GetClass('a'), classes.GetClass('\0'));
+    EXPECT_NE(classes.GetClass('0'), classes.GetClass('a'));
+    EXPECT_EQ(classes.GetRepresentative(classes.GetClass('5')), '0');
+    EXPECT_EQ(classes.GetLetters(classes.GetClass('5')).Size(), 10);
+
+    formal::CompiledDFA compiled(aut);
+    EXPECT_EQ(compiled.GetClassesCount(), 2);
+    EXPECT_TRUE(compiled.Match("a1b2"));
+    EXPECT_FALSE(compiled.Match("a1b2c3"));
+
+    for (auto algorithm : { formal::MinimizationAlgorithm::Moore, formal::MinimizationAlgorithm::Hopcroft }) {
+        formal::Automaton minimized = formal::BuildProduct(aut, aut, formal::ProductOperation::Intersection);
+        formal::MinimizeCDFA(minimized, algorithm);
+        EXPECT_EQ(minimized.GetStates().size(), 2);
+        EXPECT_TRUE(formal::IsCDFA(minimized));
+        EXPECT_TRUE(formal::AreEquivalent(aut, minimized));
+    }
+
+    // Missing transitions by a class are completed all at once
+    states[1]->RemoveTransition("7", states[2]);
+    formal::CompleteDFA(aut);
+    EXPECT_TRUE(formal::IsCDFA(aut));
+    EXPECT_EQ(aut.GetStates().size(), 5);
+
+    // Letters outside the alphabet never share a class with letters inside
+    formal::Automaton partial({ 'a', 'b' });
+    partial.InsertState()->MarkAsInitial();
+    formal::ByteClasses partial_classes(partial);
+    EXPECT_EQ(partial_classes.GetClassesCount(), 2);
+    EXPECT_EQ(partial_classes.GetClass('a'), partial_classes.GetClass('b'));
+    EXPECT_NE(partial_classes.GetClass('a'), partial_classes.GetClass('c'));
+}
+
+TEST(GeneralTest, ProductTest) {
+    std::mt19937 rng(21);
+    const formal::ProductOperation operations[] = { formal::ProductOperation::Intersection,
+                                                    formal::ProductOperation::Union,
+                                                    formal::ProductOperation::Difference,
+                                                    formal::ProductOperation::SymmetricDifference };
+    const formal::ImplicitSink sinks[] = { formal::ImplicitSink::None, formal::ImplicitSink::Rejecting,
+                                           formal::ImplicitSink::Accepting };
+
+    for (int iter = 0; iter < 30; iter++) {
+        formal::Automaton lhs;
+        formal::Automaton rhs;
+        RandomCDFA(lhs, 2 + iter % 3, rng);
+        RandomCDFA(rhs, 2 + iter % 2, rng);
+
+        // Partial DFAs with all kinds of sinks
+        for (formal::Automaton* aut : { &lhs, &rhs }) {
+            formal::AutomatonState* state = aut->GetStates()[rng() % aut->GetStates().size()];
+            formal::AutomatonState* dst_state = state->FindTransition(formal::LetterToSymbol('a'));
+            state->RemoveTransition("a", dst_state);
+            aut->SetImplicitSink(sinks[rng() % 3]);
+        }
+
+        formal::CompiledDFA compiled_lhs(lhs);
+        formal::CompiledDFA compiled_rhs(rhs);
+
+        for (formal::ProductOperation operation : operations) {
+            formal::Automaton product = formal::BuildProduct(lhs, rhs, operation);
+            formal::ProductMatcher matcher(lhs, rhs, operation);
+            EXPECT_TRUE(product.IsDFA());
+            // Pairs with a sink on one side, but never both
+            EXPECT_LT(product.GetStates().size(), (lhs.GetStates().size() + 1) * (rhs.GetStates().size() + 1));
+
+            // Shortest accepted word of the product is shorter than its states count
+            bool empty = true;
+            ForEachWord("ab", 12, [&](const std::string& word) {
+                bool in_lhs = compiled_lhs.Match(word);
+                bool in_rhs = compiled_rhs.Match(word);
+                bool expected = operation == formal::ProductOperation::Intersection ? in_lhs && in_rhs
+                                : operation == formal::ProductOperation::Union      ? in_lhs || in_rhs
+                                : operation == formal::ProductOperation::Difference ? in_lhs && !in_rhs
+                                                                                    : in_lhs != in_rhs;
+                empty = empty && !expected;
+                if (word.size() <= 7) {
+                    EXPECT_EQ(formal::DFAReadWord(product, word), expected) << word;
+                    EXPECT_EQ(matcher.Match(word), expected) << word;
+                }
+            });
+
+            EXPECT_EQ(formal::IsProductEmpty(lhs, rhs, operation), empty);
+        }
+    }
+
+    // Wrappers
+    formal::Automaton lhs;
+    formal::Automaton rhs;
+    RandomCDFA(lhs, 4, rng);
+    RandomCDFA(rhs, 4, rng);
+    ExpectSameLanguage(formal::Intersect(lhs, rhs),
+                       formal::BuildProduct(lhs, rhs, formal::ProductOperation::Intersection), 6);
+    ExpectSameLanguage(formal::Union(lhs, rhs), formal::BuildProduct(lhs, rhs, formal::ProductOperation::Union), 6);
+    EXPECT_TRUE(formal::IsProductEmpty(lhs, lhs, formal::ProductOperation::SymmetricDifference));
+    EXPECT_TRUE(formal::IsProductEmpty(formal::Difference(lhs, rhs), rhs, formal::ProductOperation::Intersection));
+
+    // Letters outside the alphabet do not make up for missing ones on the way to the accepting sink
+    formal::Automaton loop;
+    formal::AutomatonState* state = loop.InsertState();
+    state->MarkAsInitial();
+    state->AddTransition("a", state);
+    state->AddTransition("c", state);
+    loop.SetImplicitSink(formal::ImplicitSink::Accepting);
+    formal::Automaton loop_product = formal::BuildProduct(loop, loop, formal::ProductOperation::Intersection);
+    EXPECT_TRUE(formal::DFAReadWord(loop, "b"));
+    EXPECT_TRUE(formal::DFAReadWord(loop_product, "b"));
+    EXPECT_FALSE(formal::IsProductEmpty(loop, loop, formal::ProductOperation::Intersection));
+}
+
+TEST(GeneralTest, EquivalenceTest) {
+    std::mt19937 rng(34);
+    const formal::ImplicitSink sinks[] = { formal::ImplicitSink::None, formal::ImplicitSink::Accepting };
+
+    // Shortest word from words of length up to max_len which is accepted by exactly one of matchers
+    auto brute_force = [](auto lhs_accepts, auto rhs_accepts, int max_len) {
+        std::optional<std::string> shortest;
+        ForEachWord("ab", max_len, [&](const std::string& word) {
+            if (!shortest.has_value() && lhs_accepts(word) != rhs_accepts(word)) {
+                shortest = word;
+            }
+        });
+
+        return shortest;
+    };
+
+    for (int iter = 0; iter < 30; iter++) {
+        formal::Automaton lhs;
+        formal::Automaton rhs;
+        RandomCDFA(lhs, 1 + iter % 2, rng);
+        RandomCDFA(rhs, 1 + iter % 3, rng);
+
+        for (formal::Automaton* aut : { &lhs, &rhs }) {
+            formal::AutomatonState* state = aut->GetStates()[rng() % aut->GetStates().size()];
+            state->RemoveTransition("b", state->FindTransition(formal::LetterToSymbol('b')));
+            aut->SetImplicitSink(sinks[rng() % 2]);
+        }
+
+        // Shortest counterexample is shorter than the count of pairs
+        formal::CompiledDFA lhs_compiled(lhs);
+        formal::CompiledDFA rhs_compiled(rhs);
+        auto expected = brute_force([&](const std::string& word) { return lhs_compiled.Match(word); },
+                                    [&](const std::string& word) { return rhs_compiled.Match(word); }, 11);
+
+        std::string counterexample;
+        EXPECT_EQ(formal::AreEquivalent(lhs, rhs, &counterexample), !expected.has_value());
+        if (expected.has_value()) {
+            EXPECT_EQ(counterexample.size(), expected->size());
+            EXPECT_NE(formal::DFAReadWord(lhs, counterexample), formal::DFAReadWord(rhs, counterexample));
+        }
+
+        formal::Automaton minimized = formal::BuildProduct(lhs, lhs, formal::ProductOperation::Intersection);
+        formal::MinimizeDFA(minimized);
+        EXPECT_TRUE(formal::AreEquivalent(lhs, minimized));
+    }
+
+    for (int iter = 0; iter < 30; iter++) {
+        // Small NFAs, the shortest counterexample is shorter than count of (state, subset) pairs
+        formal::Automaton lhs;
+        formal::Automaton rhs;
+        for (auto [aut, states_count] : { std::make_pair(&lhs, 2), std::make_pair(&rhs, 2) }) {
+            std::vector<formal::AutomatonState*> states;
+            for (int i = 0; i < states_count; i++) {
+                states.push_back(aut->InsertState());
+                if (rng() % 2 == 0) {
+                    states.back()->MarkAsFinal();
+                }
+            }
+
+            states[0]->MarkAsInitial();
+            for (int i = 0; i < states_count * 2; i++) {
+                states[rng() % states_count]->AddTransition(rng() % 2 == 0 ? "a" : "b", states[rng() % states_count]);
+            }
+        }
+
+        formal::NFAMatcher lhs_matcher(lhs);
+        formal::NFAMatcher rhs_matcher(rhs);
+        auto expected = brute_force([&](const std::string& word) { return lhs_matcher.Match(word); },
+                                    [&](const std::string& word) { return lhs_matcher.Match(word) && rhs_matcher.Match(word); },
+                                    8);
+
+        std::string counterexample;
+        EXPECT_EQ(formal::IsIncluded(lhs, rhs, &counterexample), !expected.has_value());
+        if (expected.has_value()) {
+            EXPECT_EQ(counterexample.size(), expected->size());
+            EXPECT_TRUE(lhs_matcher.Match(counterexample) && !rhs_matcher.Match(counterexample));
+        }
+
+        EXPECT_TRUE(formal::IsIncluded(lhs, lhs));
+    }
+}
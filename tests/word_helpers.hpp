@@ -0,0 +1,39 @@
+#pragma once
+
+#include <libformal/algorithms.hpp>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+/**
+ * Calls func(word) for every word over the alphabet up to max_len.
+ * Shorter words go first, among words of the same length the first letter changes fastest
+ */
+template <typename Func>
+void ForEachWord(std::string_view alphabet, int max_len, Func func) {
+    std::string word;
+    for (int len = 0; len <= max_len; len++) {
+        word.assign(len, alphabet.front());
+        while (true) {
+            func(static_cast<const std::string&>(word));
+
+            int pos = 0;
+            while (pos < len && word[pos] == alphabet.back()) {
+                word[pos++] = alphabet.front();
+            }
+
+            if (pos == len) {
+                break;
+            }
+
+            word[pos] = alphabet[alphabet.find(word[pos]) + 1];
+        }
+    }
+}
+
+/// Compares languages of given DFAs on all words over {a, b} up to max_len
+inline void ExpectSameLanguage(const formal::Automaton& aut1, const formal::Automaton& aut2, int max_len) {
+    ForEachWord("ab", max_len, [&](const std::string& word) {
+        EXPECT_EQ(formal::DFAReadWord(aut1, word), formal::DFAReadWord(aut2, word)) << word;
+    });
+}